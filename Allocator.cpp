@@ -0,0 +1,207 @@
+#include "Allocator.h"
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <vector>
+
+namespace Matrix {
+    namespace {
+        thread_local Allocator *threadAllocator = nullptr;
+
+        // Chunk headers sit at the start of their own allocation; usable
+        // space begins at the next cache line.
+        constexpr std::size_t ChunkAlignment = 64;
+
+        std::size_t alignUp(std::size_t value, std::size_t alignment) {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        std::atomic<std::size_t> poolLimit{std::size_t(64) << 20};
+
+        // Free lists of one thread. Matrices are often few distinct sizes, so
+        // a linear scan over the classes beats hashing.
+        struct PoolState {
+            struct SizeClass {
+                std::size_t bytes;
+                std::size_t alignment;
+                std::vector<void *> buffers;
+            };
+
+            std::vector<SizeClass> classes;
+            BufferPool::Stats stats{0, 0, 0};
+
+            SizeClass &find(std::size_t bytes, std::size_t alignment) {
+                for (SizeClass &c : classes) {
+                    if (c.bytes == bytes && c.alignment == alignment) return c;
+                }
+                classes.push_back({bytes, alignment, {}});
+                return classes.back();
+            }
+
+            void release() {
+                for (SizeClass &c : classes) {
+                    for (void *p : c.buffers) {
+                        HeapAllocator::instance().deallocate(p, c.bytes, c.alignment);
+                    }
+                }
+                classes.clear();
+                stats.bytesRetained = 0;
+            }
+
+            ~PoolState();
+        };
+
+        // Matrices with static storage duration can be destroyed after the
+        // thread's pool; this flag (trivially destructible) sends them to
+        // the heap instead.
+        thread_local bool poolAlive = false;
+        thread_local PoolState poolState;
+
+        PoolState &pool() {
+            poolAlive = true;
+            return poolState;
+        }
+
+        PoolState::~PoolState() {
+            release();
+            poolAlive = false;
+        }
+    }
+
+    void *HeapAllocator::allocate(std::size_t bytes, std::size_t alignment) {
+        return ::operator new[](bytes, std::align_val_t(alignment));
+    }
+
+    void HeapAllocator::deallocate(void *p, std::size_t, std::size_t alignment) noexcept {
+        ::operator delete[](p, std::align_val_t(alignment));
+    }
+
+    HeapAllocator &HeapAllocator::instance() {
+        static HeapAllocator heap;
+        return heap;
+    }
+
+    void *BufferPool::allocate(std::size_t bytes, std::size_t alignment) {
+        PoolState &state = pool();
+        PoolState::SizeClass &c = state.find(bytes, alignment);
+        if (c.buffers.empty()) {
+            ++state.stats.misses;
+            return HeapAllocator::instance().allocate(bytes, alignment);
+        }
+        void *p = c.buffers.back();
+        c.buffers.pop_back();
+        ++state.stats.hits;
+        state.stats.bytesRetained -= bytes;
+        return p;
+    }
+
+    void BufferPool::deallocate(void *p, std::size_t bytes, std::size_t alignment) noexcept {
+        if (poolAlive && poolState.stats.bytesRetained + bytes <= retentionLimit()) {
+            try {
+                poolState.find(bytes, alignment).buffers.push_back(p);
+                poolState.stats.bytesRetained += bytes;
+                return;
+            } catch (const std::bad_alloc &) {
+            }
+        }
+        HeapAllocator::instance().deallocate(p, bytes, alignment);
+    }
+
+    BufferPool::Stats BufferPool::stats() const {
+        return poolAlive ? poolState.stats : Stats{0, 0, 0};
+    }
+
+    void BufferPool::resetStats() {
+        PoolState &state = pool();
+        state.stats.hits = 0;
+        state.stats.misses = 0;
+    }
+
+    void BufferPool::release() {
+        if (poolAlive) poolState.release();
+    }
+
+    void BufferPool::setRetentionLimit(std::size_t bytes) {
+        poolLimit.store(bytes, std::memory_order_relaxed);
+    }
+
+    std::size_t BufferPool::retentionLimit() const {
+        return poolLimit.load(std::memory_order_relaxed);
+    }
+
+    BufferPool &BufferPool::instance() {
+        static BufferPool pool;
+        return pool;
+    }
+
+    char *Arena::begin(Chunk *chunk) {
+        return reinterpret_cast<char *>(chunk) + alignUp(sizeof(Chunk), ChunkAlignment);
+    }
+
+    Arena::Chunk *Arena::newChunk(std::size_t minimum) {
+        const std::size_t capacity = std::max(chunkBytes, minimum);
+        void *memory = ::operator new[](alignUp(sizeof(Chunk), ChunkAlignment) + capacity,
+                                        std::align_val_t(ChunkAlignment));
+        return new(memory) Chunk{nullptr, capacity};
+    }
+
+    Arena::Arena(std::size_t chunkBytes): chunkBytes(chunkBytes) {
+    }
+
+    Arena::~Arena() {
+        while (first) {
+            Chunk *next = first->next;
+            ::operator delete[](first, std::align_val_t(ChunkAlignment));
+            first = next;
+        }
+    }
+
+    void *Arena::allocate(std::size_t bytes, std::size_t alignment) {
+        // Over-reserve by the alignment so a fresh chunk always fits the request.
+        const std::size_t worstCase = bytes + alignment;
+        if (!current) {
+            first = current = newChunk(worstCase);
+            offset = 0;
+        }
+        while (true) {
+            char *base = begin(current);
+            const std::size_t start = alignUp(reinterpret_cast<std::size_t>(base + offset), alignment) -
+                                      reinterpret_cast<std::size_t>(base);
+            if (start + bytes <= current->capacity) {
+                offset = start + bytes;
+                bytesUsed += bytes;
+                return base + start;
+            }
+            // Reuse chunks kept from before a reset(), else grow the chain.
+            while (current->next && current->next->capacity < worstCase) {
+                current = current->next;
+            }
+            if (!current->next) {
+                current->next = newChunk(worstCase);
+            }
+            current = current->next;
+            offset = 0;
+        }
+    }
+
+    void Arena::deallocate(void *, std::size_t, std::size_t) noexcept {
+    }
+
+    void Arena::reset() {
+        current = first;
+        offset = 0;
+        bytesUsed = 0;
+    }
+
+    Allocator &currentAllocator() {
+        return threadAllocator ? *threadAllocator : static_cast<Allocator &>(BufferPool::instance());
+    }
+
+    ScopedAllocator::ScopedAllocator(Allocator &allocator): previous(threadAllocator) {
+        threadAllocator = &allocator;
+    }
+
+    ScopedAllocator::~ScopedAllocator() {
+        threadAllocator = previous;
+    }
+} // Matrix
@@ -0,0 +1,128 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <cstddef>
+
+namespace Matrix {
+    // Source of the heap storage behind matrices (inline storage of small
+    // matrices never goes through it).
+    class Allocator {
+    public:
+        virtual ~Allocator() = default;
+
+        virtual void *allocate(std::size_t bytes, std::size_t alignment) = 0;
+
+        virtual void deallocate(void *p, std::size_t bytes, std::size_t alignment) noexcept = 0;
+    };
+
+    // Aligned global operator new / delete.
+    class HeapAllocator : public Allocator {
+    public:
+        void *allocate(std::size_t bytes, std::size_t alignment) override;
+
+        void deallocate(void *p, std::size_t bytes, std::size_t alignment) noexcept override;
+
+        static HeapAllocator &instance();
+    };
+
+    // Recycles freed buffers by size: deallocate() keeps a buffer on the
+    // calling thread's free list for its byte size, and allocate() reuses one
+    // before going to the heap, so loops that keep producing temporaries of
+    // the same few sizes stop allocating after the first iteration. Each
+    // thread retains at most retentionLimit() bytes and hands anything beyond
+    // that straight back to the heap. This is the default allocator.
+    class BufferPool : public Allocator {
+    public:
+        struct Stats {
+            std::size_t hits; // allocations served from a free list
+            std::size_t misses; // allocations that went to the heap
+            std::size_t bytesRetained; // bytes currently held on free lists
+        };
+
+        void *allocate(std::size_t bytes, std::size_t alignment) override;
+
+        void deallocate(void *p, std::size_t bytes, std::size_t alignment) noexcept override;
+
+        // Counters of the calling thread; resetStats() zeroes hits and misses.
+        Stats stats() const;
+
+        void resetStats();
+
+        // Returns every buffer the calling thread retains to the heap.
+        void release();
+
+        // Per-thread cap on retained bytes (64 MiB by default); 0 disables
+        // recycling.
+        void setRetentionLimit(std::size_t bytes);
+
+        std::size_t retentionLimit() const;
+
+        static BufferPool &instance();
+    };
+
+    // Bump allocator: allocation advances a pointer through chunks obtained
+    // from the heap, deallocate() does nothing and reset() reclaims everything
+    // at once. Matrices allocated from an arena must be destroyed (or no
+    // longer used) before it is reset or destroyed. Not thread-safe; use one
+    // arena per thread.
+    class Arena : public Allocator {
+    private:
+        struct Chunk {
+            Chunk *next;
+            std::size_t capacity;
+        };
+
+        std::size_t chunkBytes;
+        Chunk *first = nullptr;
+        Chunk *current = nullptr;
+        std::size_t offset = 0;
+        std::size_t bytesUsed = 0;
+
+        static char *begin(Chunk *chunk);
+
+        Chunk *newChunk(std::size_t minimum);
+
+    public:
+        explicit Arena(std::size_t chunkBytes = 1 << 20);
+
+        ~Arena() override;
+
+        Arena(const Arena &) = delete;
+
+        Arena &operator=(const Arena &) = delete;
+
+        void *allocate(std::size_t bytes, std::size_t alignment) override;
+
+        void deallocate(void *p, std::size_t bytes, std::size_t alignment) noexcept override;
+
+        // Makes all chunks available again without returning them to the heap.
+        void reset();
+
+        // Bytes handed out since construction or the last reset().
+        std::size_t used() const {
+            return bytesUsed;
+        }
+    };
+
+    // Allocator new matrices on the calling thread draw from: the innermost
+    // live ScopedAllocator, or BufferPool::instance().
+    Allocator &currentAllocator();
+
+    // Makes `allocator` the calling thread's current allocator for the
+    // lifetime of this object.
+    class ScopedAllocator {
+    private:
+        Allocator *previous;
+
+    public:
+        explicit ScopedAllocator(Allocator &allocator);
+
+        ~ScopedAllocator();
+
+        ScopedAllocator(const ScopedAllocator &) = delete;
+
+        ScopedAllocator &operator=(const ScopedAllocator &) = delete;
+    };
+} // Matrix
+
+#endif //ALLOCATOR_H
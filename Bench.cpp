@@ -0,0 +1,270 @@
+#include "SquareMat.h"
+#include "Expr.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace Matrix;
+
+// Usage: benchmark [--format csv|json] [--min-size N] [--max-size N] [--min-time SECONDS] [--only OP]
+// Sizes run over powers of two from --min-size (2) to --max-size (4096).
+// Every operator is repeated until --min-time (0.2 s) has passed.
+
+// ================= ALLOCATION COUNTING ===================
+
+namespace {
+    std::atomic<unsigned long long> allocatedBytes{0};
+    std::atomic<unsigned long long> allocationCount{0};
+
+    void *countedAlloc(std::size_t bytes, std::size_t alignment) {
+        allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        void *p = nullptr;
+        if (alignment <= alignof(std::max_align_t)) {
+            p = std::malloc(bytes ? bytes : 1);
+        } else if (posix_memalign(&p, alignment, bytes ? bytes : 1) != 0) {
+            p = nullptr;
+        }
+        if (!p) throw std::bad_alloc();
+        return p;
+    }
+}
+
+void *operator new(std::size_t bytes) { return countedAlloc(bytes, 0); }
+void *operator new[](std::size_t bytes) { return countedAlloc(bytes, 0); }
+void *operator new(std::size_t bytes, std::align_val_t align) { return countedAlloc(bytes, static_cast<std::size_t>(align)); }
+void *operator new[](std::size_t bytes, std::align_val_t align) { return countedAlloc(bytes, static_cast<std::size_t>(align)); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+// ================= FIXTURE ===================
+
+namespace {
+    volatile double sink;
+
+    // Operands shared by all cases of one size. A and B are random; I is the
+    // identity and One is all ones, so that repeated in-place updates keep the
+    // working matrix's values stable.
+    struct Fixture {
+        int n;
+        SquareMat A, B, I, One, W;
+
+        explicit Fixture(int n): n(n), A(n), B(n), I(n), One(n), W(n) {
+            unsigned state = 12345u + n;
+            const double scale = std::sqrt(3.0 / n);
+            for (int i = 0; i < n; ++i)
+                for (int j = 0; j < n; ++j) {
+                    state = state * 1664525u + 1013904223u;
+                    A(i, j) = (static_cast<double>(state >> 8) / (1u << 23) - 1.0) * scale;
+                    state = state * 1664525u + 1013904223u;
+                    B(i, j) = (static_cast<double>(state >> 8) / (1u << 23) - 1.0) * scale + 2.0;
+                    I(i, j) = i == j;
+                    One(i, j) = 1.0;
+                }
+            W = A;
+        }
+    };
+
+    void keep(const SquareMat &m) { sink = m(0, 0); }
+
+    void keep(double value) { sink = value; }
+
+    double cube(int n) { return static_cast<double>(n) * n * n; }
+
+    double square(int n) { return static_cast<double>(n) * n; }
+
+    double none(int) { return 0; }
+
+    struct Case {
+        const char *name;
+        double (*flops)(int n);
+        std::function<void(Fixture &)> run;
+    };
+
+    const int PowerExponent = 8;
+
+    std::vector<Case> cases() {
+        return {
+            {"copy", none, [](Fixture &f) { SquareMat c(f.A); keep(c); }},
+            {"operator[]", square, [](Fixture &f) {
+                double s = 0;
+                for (int i = 0; i < f.n; ++i)
+                    for (int j = 0; j < f.n; ++j)
+                        s += f.A[i][j];
+                keep(s);
+            }},
+            {"operator+", square, [](Fixture &f) { keep(f.A + f.B); }},
+            {"operator-", square, [](Fixture &f) { keep(f.A - f.B); }},
+            {"unary operator-", square, [](Fixture &f) { keep(-f.A); }},
+            {"operator*(matrix)", [](int n) { return 2 * cube(n); }, [](Fixture &f) { keep(f.A * f.B); }},
+            {"~A * B", [](int n) { return 2 * cube(n); }, [](Fixture &f) { keep(~f.A * f.B); }},
+            {"A.transposed() * B", [](int n) { return 2 * cube(n); }, [](Fixture &f) { keep(f.A.transposed() * f.B); }},
+            {"A * B.transposed()", [](int n) { return 2 * cube(n); }, [](Fixture &f) { keep(f.A * f.B.transposed()); }},
+            {"operator*(scalar)", square, [](Fixture &f) { keep(f.A * 1.5); }},
+            {"scalar*matrix", square, [](Fixture &f) { keep(1.5 * f.A); }},
+            {"operator%(matrix)", square, [](Fixture &f) { keep(f.A % f.B); }},
+            {"operator%(int)", square, [](Fixture &f) { keep(f.B % 3); }},
+            {"operator/", square, [](Fixture &f) { keep(f.A / 1.5); }},
+            {"operator^", [](int n) { return 2 * 3 * cube(n); }, [](Fixture &f) { keep(f.A ^ PowerExponent); }},
+            {"A + B - A * 2.0 (eager)", [](int n) { return 3 * square(n); }, [](Fixture &f) {
+                f.W = f.A + f.B - f.A * 2.0;
+                keep(f.W);
+            }},
+            {"A + B - A * 2.0 (lazy)", [](int n) { return 3 * square(n); }, [](Fixture &f) {
+                f.W = lazy(f.A) + f.B - lazy(f.A) * 2.0;
+                keep(f.W);
+            }},
+            {"operator+=", square, [](Fixture &f) { keep(f.W += f.A); }},
+            {"operator-=", square, [](Fixture &f) { keep(f.W -= f.A); }},
+            {"operator*=(matrix)", [](int n) { return 2 * cube(n); }, [](Fixture &f) { keep(f.W *= f.I); }},
+            {"operator*=(scalar)", square, [](Fixture &f) { keep(f.W *= 1.0); }},
+            {"operator%=(matrix)", square, [](Fixture &f) { keep(f.W %= f.One); }},
+            {"operator%=(int)", square, [](Fixture &f) { keep(f.W %= 7); }},
+            {"operator/=", square, [](Fixture &f) { keep(f.W /= 1.0); }},
+            {"addScaled", [](int n) { return 2 * square(n); }, [](Fixture &f) { keep(f.W.addScaled(f.A, 0.0)); }},
+            {"operator++ (pre)", square, [](Fixture &f) { keep(++f.W); }},
+            {"operator++ (post)", square, [](Fixture &f) { keep(f.W++); }},
+            {"operator-- (pre)", square, [](Fixture &f) { keep(--f.W); }},
+            {"operator-- (post)", square, [](Fixture &f) { keep(f.W--); }},
+            {"operator~", none, [](Fixture &f) { keep(~f.A); }},
+            {"transposeInPlace", none, [](Fixture &f) { keep(f.W.transposeInPlace()); }},
+            {"operator!", [](int n) { return 2 * cube(n) / 3; }, [](Fixture &f) { keep(!f.B); }},
+            {"logDeterminant", [](int n) { return 2 * cube(n) / 3; }, [](Fixture &f) {
+                int sign;
+                keep(f.B.logDeterminant(sign));
+            }},
+            {"operator==", square, [](Fixture &f) { keep(f.A == f.W); }},
+            {"hash (after write)", square, [](Fixture &f) {
+                f.W(0, 0) += 1;
+                keep(static_cast<double>(f.W.hash()));
+            }},
+            {"approxEqual", square, [](Fixture &f) { keep(approxEqual(f.A, f.A, 1e-12, 1e-12).equal); }},
+            {"ulpEqual", square, [](Fixture &f) { keep(ulpEqual(f.A, f.A, 4).equal); }},
+            {"operator!=", square, [](Fixture &f) { keep(f.A != f.W); }},
+            {"operator<", [](int n) { return 2 * square(n); }, [](Fixture &f) { keep(f.A < f.B); }},
+            {"operator< (after write)", square, [](Fixture &f) {
+                f.W(0, 0) += 1;
+                keep(f.W < f.A);
+            }},
+            {"operator<=", [](int n) { return 2 * square(n); }, [](Fixture &f) { keep(f.A <= f.B); }},
+            {"operator>", [](int n) { return 2 * square(n); }, [](Fixture &f) { keep(f.A > f.B); }},
+            {"operator>=", [](int n) { return 2 * square(n); }, [](Fixture &f) { keep(f.A >= f.B); }},
+            {"operator<<", none, [](Fixture &f) {
+                std::ostringstream out;
+                out << f.A;
+                keep(static_cast<double>(out.tellp()));
+            }},
+        };
+    }
+
+    struct Result {
+        std::string name;
+        int size;
+        unsigned long long iterations;
+        double nsPerOp;
+        double gflops;
+        double bytesPerOp;
+        double allocsPerOp;
+    };
+
+    Result measure(const Case &c, Fixture &fixture, double minTime) {
+        using Clock = std::chrono::steady_clock;
+        c.run(fixture); // warm-up
+        unsigned long long iterations = 1;
+        while (true) {
+            const unsigned long long bytesBefore = allocatedBytes.load();
+            const unsigned long long countBefore = allocationCount.load();
+            const Clock::time_point start = Clock::now();
+            for (unsigned long long i = 0; i < iterations; ++i) {
+                c.run(fixture);
+            }
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if (seconds >= minTime || iterations >= (1ull << 40)) {
+                const double perOp = seconds / iterations;
+                return {c.name, fixture.n, iterations, perOp * 1e9,
+                        perOp > 0 ? c.flops(fixture.n) / perOp * 1e-9 : 0,
+                        static_cast<double>(allocatedBytes.load() - bytesBefore) / iterations,
+                        static_cast<double>(allocationCount.load() - countBefore) / iterations};
+            }
+            const double grow = seconds > 0 ? minTime / seconds * 1.2 : 10;
+            iterations = static_cast<unsigned long long>(iterations * (grow < 10 ? (grow > 2 ? grow : 2) : 10));
+        }
+    }
+
+    void printCsvHeader() {
+        std::cout << "operator,size,iterations,ns_per_op,gflops,bytes_allocated_per_op,allocations_per_op\n";
+    }
+
+    void printCsv(const Result &r) {
+        std::cout << '"' << r.name << "\"," << r.size << ',' << r.iterations << ',' << r.nsPerOp << ','
+                  << r.gflops << ',' << r.bytesPerOp << ',' << r.allocsPerOp << '\n';
+    }
+
+    void printJson(const Result &r, bool first) {
+        std::cout << (first ? "[\n" : ",\n") << "  {\"operator\": \"" << r.name << "\", \"size\": " << r.size
+                  << ", \"iterations\": " << r.iterations << ", \"ns_per_op\": " << r.nsPerOp
+                  << ", \"gflops\": " << r.gflops << ", \"bytes_allocated_per_op\": " << r.bytesPerOp
+                  << ", \"allocations_per_op\": " << r.allocsPerOp << "}";
+    }
+}
+
+int main(int argc, char **argv) {
+    bool json = false;
+    int minSize = 2, maxSize = 4096;
+    double minTime = 0.2;
+    std::string only;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--format" && value) {
+            json = std::strcmp(value, "json") == 0;
+        } else if (arg == "--min-size" && value) {
+            minSize = std::atoi(value);
+        } else if (arg == "--max-size" && value) {
+            maxSize = std::atoi(value);
+        } else if (arg == "--min-time" && value) {
+            minTime = std::atof(value);
+        } else if (arg == "--only" && value) {
+            only = value;
+        } else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--format csv|json] [--min-size N] [--max-size N] [--min-time SECONDS] [--only OP]\n";
+            return 1;
+        }
+        ++i;
+    }
+
+    const std::vector<Case> all = cases();
+    bool first = true;
+    if (!json) printCsvHeader();
+    for (int n = minSize; n <= maxSize; n *= 2) {
+        Fixture fixture(n);
+        for (const Case &c : all) {
+            if (!only.empty() && only != c.name) continue;
+            fixture.W = fixture.A;
+            const Result r = measure(c, fixture, minTime);
+            if (json) {
+                printJson(r, first);
+            } else {
+                printCsv(r);
+            }
+            first = false;
+            std::cout.flush();
+        }
+    }
+    if (json) std::cout << (first ? "[]\n" : "\n]\n");
+    return 0;
+}
@@ -0,0 +1,543 @@
+#include "Elementwise.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ELEMENTWISE_X86 1
+#endif
+
+namespace Matrix {
+    namespace Elementwise {
+        namespace {
+            // Each operation is a functor with a scalar form and, on x86, one
+            // per vector width; `s` is the broadcast scalar or the other operand.
+            struct Add {
+                static double scalar(double x, double s) { return x + s; }
+#ifdef ELEMENTWISE_X86
+                __attribute__((target("avx2"))) static __m256d avx2(__m256d x, __m256d s) { return _mm256_add_pd(x, s); }
+                __attribute__((target("avx512f"))) static __m512d avx512(__m512d x, __m512d s) { return _mm512_add_pd(x, s); }
+#endif
+            };
+
+            struct Subtract {
+                static double scalar(double x, double s) { return x - s; }
+#ifdef ELEMENTWISE_X86
+                __attribute__((target("avx2"))) static __m256d avx2(__m256d x, __m256d s) { return _mm256_sub_pd(x, s); }
+                __attribute__((target("avx512f"))) static __m512d avx512(__m512d x, __m512d s) { return _mm512_sub_pd(x, s); }
+#endif
+            };
+
+            struct Multiply {
+                static double scalar(double x, double s) { return x * s; }
+#ifdef ELEMENTWISE_X86
+                __attribute__((target("avx2"))) static __m256d avx2(__m256d x, __m256d s) { return _mm256_mul_pd(x, s); }
+                __attribute__((target("avx512f"))) static __m512d avx512(__m512d x, __m512d s) { return _mm512_mul_pd(x, s); }
+#endif
+            };
+
+            struct Divide {
+                static double scalar(double x, double s) { return x / s; }
+#ifdef ELEMENTWISE_X86
+                __attribute__((target("avx2"))) static __m256d avx2(__m256d x, __m256d s) { return _mm256_div_pd(x, s); }
+                __attribute__((target("avx512f"))) static __m512d avx512(__m512d x, __m512d s) { return _mm512_div_pd(x, s); }
+#endif
+            };
+
+            // Flips the sign bit, which is what -x does (0 - x would turn -0 into +0).
+            struct Negate {
+                static double scalar(double x, double) { return -x; }
+#ifdef ELEMENTWISE_X86
+                __attribute__((target("avx2"))) static __m256d avx2(__m256d x, __m256d) {
+                    return _mm256_xor_pd(x, _mm256_set1_pd(-0.0));
+                }
+                __attribute__((target("avx512f"))) static __m512d avx512(__m512d x, __m512d) {
+                    return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(x),
+                                                                _mm512_set1_epi64(static_cast<long long>(1ull << 63))));
+                }
+#endif
+            };
+
+            // out[i] = Op(a[i], b[i]) when Pairwise, else Op(a[i], scalar).
+            template<typename Op, bool Pairwise>
+            void runScalar(std::size_t n, const double *a, const double *b, double scalar, double *out) {
+                for (std::size_t i = 0; i < n; ++i)
+                    out[i] = Op::scalar(a[i], Pairwise ? b[i] : scalar);
+            }
+
+#ifdef ELEMENTWISE_X86
+            // Two vectors per iteration so consecutive loads and stores overlap.
+            template<typename Op, bool Pairwise>
+            __attribute__((target("avx2")))
+            void runAvx2(std::size_t n, const double *a, const double *b, double scalar, double *out) {
+                const __m256d s = _mm256_set1_pd(scalar);
+                std::size_t i = 0;
+                for (; i + 8 <= n; i += 8) {
+                    const __m256d x0 = Op::avx2(_mm256_loadu_pd(a + i), Pairwise ? _mm256_loadu_pd(b + i) : s);
+                    const __m256d x1 = Op::avx2(_mm256_loadu_pd(a + i + 4), Pairwise ? _mm256_loadu_pd(b + i + 4) : s);
+                    _mm256_storeu_pd(out + i, x0);
+                    _mm256_storeu_pd(out + i + 4, x1);
+                }
+                runScalar<Op, Pairwise>(n - i, a + i, Pairwise ? b + i : b, scalar, out + i);
+            }
+
+            // As runAvx2; the last partial vector uses masked loads and stores
+            // instead of a scalar loop.
+            template<typename Op, bool Pairwise>
+            __attribute__((target("avx512f")))
+            void runAvx512(std::size_t n, const double *a, const double *b, double scalar, double *out) {
+                const __m512d s = _mm512_set1_pd(scalar);
+                std::size_t i = 0;
+                for (; i + 16 <= n; i += 16) {
+                    const __m512d x0 = Op::avx512(_mm512_loadu_pd(a + i), Pairwise ? _mm512_loadu_pd(b + i) : s);
+                    const __m512d x1 = Op::avx512(_mm512_loadu_pd(a + i + 8), Pairwise ? _mm512_loadu_pd(b + i + 8) : s);
+                    _mm512_storeu_pd(out + i, x0);
+                    _mm512_storeu_pd(out + i + 8, x1);
+                }
+                for (; i < n; i += 8) {
+                    const __mmask8 mask = n - i >= 8 ? 0xFF : static_cast<__mmask8>((1u << (n - i)) - 1);
+                    const __m512d x = _mm512_maskz_loadu_pd(mask, a + i);
+                    const __m512d y = Pairwise ? _mm512_maskz_loadu_pd(mask, b + i) : s;
+                    _mm512_mask_storeu_pd(out + i, mask, Op::avx512(x, y));
+                }
+            }
+#endif
+
+            template<typename Op, bool Pairwise>
+            void run(std::size_t n, const double *a, const double *b, double scalar, double *out) {
+#ifdef ELEMENTWISE_X86
+                switch (Simd::active()) {
+                    case Simd::Isa::AVX512: runAvx512<Op, Pairwise>(n, a, b, scalar, out); return;
+                    case Simd::Isa::AVX2: runAvx2<Op, Pairwise>(n, a, b, scalar, out); return;
+                    default: break;
+                }
+#endif
+                runScalar<Op, Pairwise>(n, a, b, scalar, out);
+            }
+
+            // out[i] + alpha * a[i], multiplied and added separately.
+            template<typename T>
+            void addScaledScalar(std::size_t n, const T *a, T alpha, T *out) {
+                for (std::size_t i = 0; i < n; ++i)
+                    out[i] += alpha * a[i];
+            }
+
+            // Magnitudes below this have an exact integer quotient estimate that
+            // is off by at most one.
+            constexpr double RemainderLimit = 4503599627370496.0; // 2^52
+
+            void remainderScalar(std::size_t n, const double *a, int divisor, double *out) {
+                for (std::size_t i = 0; i < n; ++i)
+                    out[i] = std::fmod(a[i], static_cast<double>(divisor));
+            }
+
+#ifdef ELEMENTWISE_X86
+            // q = trunc(x / d) is exact or one too far from zero (when x / d
+            // rounds up onto an integer); x - q * d is exact in either case, and
+            // in the second it has the wrong sign and is fixed by adding |d|
+            // with x's sign. fmod also gives 0 the sign of x.
+            __attribute__((target("avx2,fma")))
+            void remainderAvx2(std::size_t n, const double *a, int divisor, double *out) {
+                const __m256d d = _mm256_set1_pd(divisor);
+                const __m256d magnitude = _mm256_set1_pd(std::fabs(static_cast<double>(divisor)));
+                const __m256d sign = _mm256_set1_pd(-0.0);
+                const __m256d limit = _mm256_set1_pd(RemainderLimit);
+                const __m256d zero = _mm256_setzero_pd();
+                std::size_t i = 0;
+                for (; i + 4 <= n; i += 4) {
+                    const __m256d x = _mm256_loadu_pd(a + i);
+                    const __m256d q = _mm256_round_pd(_mm256_div_pd(x, d), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+                    const __m256d r = _mm256_fnmadd_pd(q, d, x);
+                    const __m256d xSign = _mm256_and_pd(x, sign);
+                    const __m256d over = _mm256_or_pd(
+                        _mm256_and_pd(_mm256_cmp_pd(r, zero, _CMP_LT_OQ), _mm256_cmp_pd(x, zero, _CMP_GT_OQ)),
+                        _mm256_and_pd(_mm256_cmp_pd(r, zero, _CMP_GT_OQ), _mm256_cmp_pd(x, zero, _CMP_LT_OQ)));
+                    const __m256d fixed = _mm256_add_pd(r, _mm256_and_pd(over, _mm256_or_pd(magnitude, xSign)));
+                    const int exact = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_andnot_pd(sign, x), limit, _CMP_LT_OQ));
+                    if (exact == 0xF) {
+                        _mm256_storeu_pd(out + i, _mm256_or_pd(_mm256_andnot_pd(sign, fixed), xSign));
+                        continue;
+                    }
+                    alignas(32) double values[4];
+                    _mm256_store_pd(values, x);
+                    remainderScalar(4, values, divisor, out + i);
+                }
+                remainderScalar(n - i, a + i, divisor, out + i);
+            }
+
+            __attribute__((target("avx512f")))
+            void remainderAvx512(std::size_t n, const double *a, int divisor, double *out) {
+                const __m512d d = _mm512_set1_pd(divisor);
+                const __m512i magnitude = _mm512_castpd_si512(_mm512_set1_pd(std::fabs(static_cast<double>(divisor))));
+                const __m512i sign = _mm512_set1_epi64(static_cast<long long>(1ull << 63));
+                const __m512d limit = _mm512_set1_pd(RemainderLimit);
+                const __m512d zero = _mm512_setzero_pd();
+                // Masked forms with an explicit pass-through operand keep GCC 12
+                // from warning about its own headers.
+                constexpr __mmask8 All = 0xFF;
+                std::size_t i = 0;
+                for (; i < n; i += 8) {
+                    const __mmask8 mask = n - i >= 8 ? 0xFF : static_cast<__mmask8>((1u << (n - i)) - 1);
+                    const __m512d x = _mm512_maskz_loadu_pd(mask, a + i);
+                    const __m512d q = _mm512_mask_roundscale_pd(x, All, _mm512_div_pd(x, d),
+                                                                 _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+                    const __m512d r = _mm512_fnmadd_pd(q, d, x);
+                    const __m512i xSign = _mm512_and_si512(_mm512_castpd_si512(x), sign);
+                    const __mmask8 over = (_mm512_cmp_pd_mask(r, zero, _CMP_LT_OQ) & _mm512_cmp_pd_mask(x, zero, _CMP_GT_OQ)) |
+                                          (_mm512_cmp_pd_mask(r, zero, _CMP_GT_OQ) & _mm512_cmp_pd_mask(x, zero, _CMP_LT_OQ));
+                    const __m512d fixed = _mm512_mask_add_pd(r, over, r, _mm512_castsi512_pd(_mm512_or_si512(magnitude, xSign)));
+                    const __m512i result = _mm512_or_si512(_mm512_mask_andnot_epi64(sign, All, sign, _mm512_castpd_si512(fixed)), xSign);
+                    const __mmask8 exact = _mm512_cmp_pd_mask(_mm512_castsi512_pd(_mm512_mask_andnot_epi64(sign, All, sign, _mm512_castpd_si512(x))),
+                                                              limit, _CMP_LT_OQ);
+                    if ((exact & mask) == mask) {
+                        _mm512_mask_storeu_pd(out + i, mask, _mm512_castsi512_pd(result));
+                        continue;
+                    }
+                    alignas(64) double values[8];
+                    _mm512_store_pd(values, x);
+                    remainderScalar(n - i >= 8 ? 8 : n - i, values, divisor, out + i);
+                }
+            }
+
+            bool equalScalar(std::size_t n, const double *a, const double *b) {
+                for (std::size_t i = 0; i < n; ++i)
+                    if (!(a[i] == b[i])) return false;
+                return true;
+            }
+
+            __attribute__((target("avx2")))
+            bool equalAvx2(std::size_t n, const double *a, const double *b) {
+                std::size_t i = 0;
+                for (; i + 16 <= n; i += 16) {
+                    __m256d same = _mm256_cmp_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), _CMP_EQ_OQ);
+                    for (std::size_t k = 4; k < 16; k += 4) {
+                        same = _mm256_and_pd(same, _mm256_cmp_pd(_mm256_loadu_pd(a + i + k), _mm256_loadu_pd(b + i + k),
+                                                                 _CMP_EQ_OQ));
+                    }
+                    if (_mm256_movemask_pd(same) != 0xF) return false;
+                }
+                return equalScalar(n - i, a + i, b + i);
+            }
+
+            __attribute__((target("avx512f")))
+            bool equalAvx512(std::size_t n, const double *a, const double *b) {
+                std::size_t i = 0;
+                for (; i + 16 <= n; i += 16) {
+                    const __mmask8 low = _mm512_cmp_pd_mask(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), _CMP_EQ_OQ);
+                    const __mmask8 high = _mm512_cmp_pd_mask(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8),
+                                                             _CMP_EQ_OQ);
+                    if ((low & high) != 0xFF) return false;
+                }
+                for (; i < n; i += 8) {
+                    const __mmask8 mask = n - i >= 8 ? 0xFF : static_cast<__mmask8>((1u << (n - i)) - 1);
+                    const __mmask8 same = _mm512_mask_cmp_pd_mask(mask, _mm512_maskz_loadu_pd(mask, a + i),
+                                                                  _mm512_maskz_loadu_pd(mask, b + i), _CMP_EQ_OQ);
+                    if (same != mask) return false;
+                }
+                return true;
+            }
+
+            // Folds the worst offender of the block starting at `offset` into `worst`.
+            void merge(Deviation &worst, std::size_t offset, const Deviation &block) {
+                if (block.excess > worst.excess) worst = {offset + block.index, block.error, block.excess};
+            }
+
+            __attribute__((target("avx2")))
+            Deviation worstOutsideAvx2(std::size_t n, const double *a, const double *b, double absTol, double relTol) {
+                Deviation worst{n, 0.0, -HUGE_VAL};
+                const __m256d sign = _mm256_set1_pd(-0.0);
+                const __m256d absolute = _mm256_set1_pd(absTol);
+                const __m256d relative = _mm256_set1_pd(relTol);
+                const __m256d infinity = _mm256_set1_pd(HUGE_VAL);
+                std::size_t i = 0;
+                for (; i + 8 <= n; i += 8) {
+                    __m256d pass = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+                    for (std::size_t k = 0; k < 8; k += 4) {
+                        const __m256d x = _mm256_loadu_pd(a + i + k);
+                        const __m256d y = _mm256_loadu_pd(b + i + k);
+                        const __m256d error = _mm256_andnot_pd(sign, _mm256_sub_pd(x, y));
+                        const __m256d largest = _mm256_max_pd(_mm256_andnot_pd(sign, x), _mm256_andnot_pd(sign, y));
+                        const __m256d allowed = _mm256_max_pd(absolute, _mm256_mul_pd(relative, largest));
+                        const __m256d close = _mm256_and_pd(_mm256_cmp_pd(error, allowed, _CMP_LE_OQ),
+                                                            _mm256_cmp_pd(error, infinity, _CMP_LT_OQ));
+                        pass = _mm256_and_pd(pass, _mm256_or_pd(_mm256_cmp_pd(x, y, _CMP_EQ_OQ), close));
+                    }
+                    if (_mm256_movemask_pd(pass) != 0xF) {
+                        merge(worst, i, worstOutside<double>(8, a + i, b + i, absTol, relTol));
+                    }
+                }
+                merge(worst, i, worstOutside<double>(n - i, a + i, b + i, absTol, relTol));
+                return worst;
+            }
+
+            __attribute__((target("avx512f")))
+            Deviation worstOutsideAvx512(std::size_t n, const double *a, const double *b, double absTol, double relTol) {
+                Deviation worst{n, 0.0, -HUGE_VAL};
+                const __m512d absolute = _mm512_set1_pd(absTol);
+                const __m512d relative = _mm512_set1_pd(relTol);
+                const __m512d infinity = _mm512_set1_pd(HUGE_VAL);
+                constexpr __mmask8 All = 0xFF; // see remainderAvx512
+                for (std::size_t i = 0; i < n; i += 16) {
+                    const std::size_t count = n - i >= 16 ? 16 : n - i;
+                    __mmask16 pass = 0;
+                    for (std::size_t k = 0; k < count; k += 8) {
+                        const __mmask8 mask = count - k >= 8 ? 0xFF : static_cast<__mmask8>((1u << (count - k)) - 1);
+                        const __m512d x = _mm512_maskz_loadu_pd(mask, a + i + k);
+                        const __m512d y = _mm512_maskz_loadu_pd(mask, b + i + k);
+                        const __m512d error = _mm512_abs_pd(_mm512_sub_pd(x, y));
+                        const __m512d largest = _mm512_mask_max_pd(x, All, _mm512_abs_pd(x), _mm512_abs_pd(y));
+                        const __m512d allowed = _mm512_mask_max_pd(x, All, absolute, _mm512_mul_pd(relative, largest));
+                        const __mmask8 close = _mm512_mask_cmp_pd_mask(mask, error, allowed, _CMP_LE_OQ) &
+                                               _mm512_mask_cmp_pd_mask(mask, error, infinity, _CMP_LT_OQ);
+                        const __mmask8 ok = _mm512_mask_cmp_pd_mask(mask, x, y, _CMP_EQ_OQ) | close;
+                        pass |= static_cast<__mmask16>(static_cast<unsigned>(ok) << k);
+                    }
+                    if (pass != static_cast<__mmask16>((1u << count) - 1)) {
+                        merge(worst, i, worstOutside<double>(count, a + i, b + i, absTol, relTol));
+                    }
+                }
+                return worst;
+            }
+
+            // Bit patterns as integers ordered like the doubles they encode:
+            // negative values are mirrored below zero, with -0 landing on 0.
+            __attribute__((target("avx2")))
+            __m256i orderedAvx2(__m256d x) {
+                const __m256i bits = _mm256_castpd_si256(x);
+                const __m256i negative = _mm256_cmpgt_epi64(_mm256_setzero_si256(), bits);
+                const __m256i mirrored = _mm256_sub_epi64(_mm256_set1_epi64x(std::numeric_limits<long long>::min()), bits);
+                return _mm256_blendv_epi8(bits, mirrored, negative);
+            }
+
+            __attribute__((target("avx2")))
+            Deviation worstUlpsAvx2(std::size_t n, const double *a, const double *b, std::uint64_t maxUlps) {
+                Deviation worst{n, 0.0, -HUGE_VAL};
+                // Unsigned comparison as a signed one with the sign bits flipped.
+                const __m256i flip = _mm256_set1_epi64x(std::numeric_limits<long long>::min());
+                const __m256i limit = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(maxUlps)), flip);
+                std::size_t i = 0;
+                for (; i + 8 <= n; i += 8) {
+                    __m256i fail = _mm256_setzero_si256();
+                    for (std::size_t k = 0; k < 8; k += 4) {
+                        const __m256d x = _mm256_loadu_pd(a + i + k);
+                        const __m256d y = _mm256_loadu_pd(b + i + k);
+                        const __m256i ox = orderedAvx2(x);
+                        const __m256i oy = orderedAvx2(y);
+                        const __m256i distance = _mm256_blendv_epi8(_mm256_sub_epi64(ox, oy), _mm256_sub_epi64(oy, ox),
+                                                                    _mm256_cmpgt_epi64(oy, ox));
+                        const __m256i over = _mm256_cmpgt_epi64(_mm256_xor_si256(distance, flip), limit);
+                        const __m256i nan = _mm256_castpd_si256(_mm256_cmp_pd(x, y, _CMP_UNORD_Q));
+                        fail = _mm256_or_si256(fail, _mm256_or_si256(over, nan));
+                    }
+                    if (!_mm256_testz_si256(fail, fail)) {
+                        merge(worst, i, worstUlps<double>(8, a + i, b + i, maxUlps));
+                    }
+                }
+                merge(worst, i, worstUlps<double>(n - i, a + i, b + i, maxUlps));
+                return worst;
+            }
+
+            __attribute__((target("avx512f")))
+            __m512i orderedAvx512(__m512d x) {
+                const __m512i bits = _mm512_castpd_si512(x);
+                const __mmask8 negative = _mm512_cmplt_epi64_mask(bits, _mm512_setzero_si512());
+                return _mm512_mask_sub_epi64(bits, negative, _mm512_set1_epi64(std::numeric_limits<long long>::min()), bits);
+            }
+
+            __attribute__((target("avx512f")))
+            Deviation worstUlpsAvx512(std::size_t n, const double *a, const double *b, std::uint64_t maxUlps) {
+                Deviation worst{n, 0.0, -HUGE_VAL};
+                const __m512i limit = _mm512_set1_epi64(static_cast<long long>(maxUlps));
+                for (std::size_t i = 0; i < n; i += 16) {
+                    const std::size_t count = n - i >= 16 ? 16 : n - i;
+                    bool fail = false;
+                    for (std::size_t k = 0; k < count; k += 8) {
+                        const __mmask8 mask = count - k >= 8 ? 0xFF : static_cast<__mmask8>((1u << (count - k)) - 1);
+                        const __m512d x = _mm512_maskz_loadu_pd(mask, a + i + k);
+                        const __m512d y = _mm512_maskz_loadu_pd(mask, b + i + k);
+                        const __m512i ox = orderedAvx512(x);
+                        const __m512i oy = orderedAvx512(y);
+                        const __m512i distance = _mm512_mask_sub_epi64(_mm512_sub_epi64(ox, oy),
+                                                                       _mm512_cmplt_epi64_mask(ox, oy), oy, ox);
+                        fail |= (_mm512_mask_cmpgt_epu64_mask(mask, distance, limit) |
+                                 _mm512_mask_cmp_pd_mask(mask, x, y, _CMP_UNORD_Q)) != 0;
+                    }
+                    if (fail) merge(worst, i, worstUlps<double>(count, a + i, b + i, maxUlps));
+                }
+                return worst;
+            }
+
+            __attribute__((target("avx2")))
+            void addScaledAvx2(std::size_t n, const double *a, double alpha, double *out) {
+                const __m256d s = _mm256_set1_pd(alpha);
+                std::size_t i = 0;
+                for (; i + 4 <= n; i += 4) {
+                    const __m256d product = _mm256_mul_pd(s, _mm256_loadu_pd(a + i));
+                    _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(out + i), product));
+                }
+                addScaledScalar(n - i, a + i, alpha, out + i);
+            }
+
+            __attribute__((target("avx512f")))
+            void addScaledAvx512(std::size_t n, const double *a, double alpha, double *out) {
+                const __m512d s = _mm512_set1_pd(alpha);
+                std::size_t i = 0;
+                for (; i + 8 <= n; i += 8) {
+                    const __m512d product = _mm512_mul_pd(s, _mm512_loadu_pd(a + i));
+                    _mm512_storeu_pd(out + i, _mm512_add_pd(_mm512_loadu_pd(out + i), product));
+                }
+                addScaledScalar(n - i, a + i, alpha, out + i);
+            }
+
+            __attribute__((target("avx2")))
+            void addScaledAvx2(std::size_t n, const float *a, float alpha, float *out) {
+                const __m256 s = _mm256_set1_ps(alpha);
+                std::size_t i = 0;
+                for (; i + 8 <= n; i += 8) {
+                    const __m256 product = _mm256_mul_ps(s, _mm256_loadu_ps(a + i));
+                    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), product));
+                }
+                addScaledScalar(n - i, a + i, alpha, out + i);
+            }
+
+            __attribute__((target("avx512f")))
+            void addScaledAvx512(std::size_t n, const float *a, float alpha, float *out) {
+                const __m512 s = _mm512_set1_ps(alpha);
+                std::size_t i = 0;
+                for (; i + 16 <= n; i += 16) {
+                    const __m512 product = _mm512_mul_ps(s, _mm512_loadu_ps(a + i));
+                    _mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(out + i), product));
+                }
+                addScaledScalar(n - i, a + i, alpha, out + i);
+            }
+#endif
+        }
+
+        void add(std::size_t n, const double *a, const double *b, double *out) {
+            run<Add, true>(n, a, b, 0.0, out);
+        }
+
+        void subtract(std::size_t n, const double *a, const double *b, double *out) {
+            run<Subtract, true>(n, a, b, 0.0, out);
+        }
+
+        void multiply(std::size_t n, const double *a, const double *b, double *out) {
+            run<Multiply, true>(n, a, b, 0.0, out);
+        }
+
+        void negate(std::size_t n, const double *a, double *out) {
+            run<Negate, false>(n, a, nullptr, 0.0, out);
+        }
+
+        void scale(std::size_t n, const double *a, double scalar, double *out) {
+            run<Multiply, false>(n, a, nullptr, scalar, out);
+        }
+
+        void divide(std::size_t n, const double *a, double scalar, double *out) {
+            run<Divide, false>(n, a, nullptr, scalar, out);
+        }
+
+        void addScalar(std::size_t n, const double *a, double scalar, double *out) {
+            run<Add, false>(n, a, nullptr, scalar, out);
+        }
+
+        void subtractScalar(std::size_t n, const double *a, double scalar, double *out) {
+            run<Subtract, false>(n, a, nullptr, scalar, out);
+        }
+
+        void addScaled(std::size_t n, const double *a, double alpha, double *out) {
+#ifdef ELEMENTWISE_X86
+            switch (Simd::active()) {
+                case Simd::Isa::AVX512: addScaledAvx512(n, a, alpha, out); return;
+                case Simd::Isa::AVX2: addScaledAvx2(n, a, alpha, out); return;
+                default: break;
+            }
+#endif
+            addScaledScalar(n, a, alpha, out);
+        }
+
+        void addScaled(std::size_t n, const float *a, float alpha, float *out) {
+#ifdef ELEMENTWISE_X86
+            switch (Simd::active()) {
+                case Simd::Isa::AVX512: addScaledAvx512(n, a, alpha, out); return;
+                case Simd::Isa::AVX2: addScaledAvx2(n, a, alpha, out); return;
+                default: break;
+            }
+#endif
+            addScaledScalar(n, a, alpha, out);
+        }
+
+        void remainder(std::size_t n, const double *a, int divisor, double *out) {
+#ifdef ELEMENTWISE_X86
+            switch (Simd::active()) {
+                case Simd::Isa::AVX512: remainderAvx512(n, a, divisor, out); return;
+                case Simd::Isa::AVX2: remainderAvx2(n, a, divisor, out); return;
+                default: break;
+            }
+#endif
+            remainderScalar(n, a, divisor, out);
+        }
+
+        // Lemire, Kaser and Kurz, "Faster remainder by direct computation":
+        // with M = ceil(2^128 / d), x mod d is the high 64 bits of
+        // (M * x mod 2^128) * d, for every 64-bit x.
+        void remainder(std::size_t n, const std::int64_t *a, int divisor, std::int64_t *out) {
+#ifdef __SIZEOF_INT128__
+            using u128 = unsigned __int128;
+            const std::uint64_t d = divisor < 0 ? 0 - static_cast<std::uint64_t>(static_cast<std::int64_t>(divisor))
+                                                : static_cast<std::uint64_t>(divisor);
+            if (d == 1) {
+                std::fill(out, out + n, 0);
+                return;
+            }
+            const u128 m = ~u128(0) / d + 1;
+            for (std::size_t i = 0; i < n; ++i) {
+                const std::int64_t x = a[i];
+                const std::uint64_t magnitude = x < 0 ? 0 - static_cast<std::uint64_t>(x) : static_cast<std::uint64_t>(x);
+                const u128 low = m * magnitude;
+                const u128 bottom = (low & ~std::uint64_t(0)) * d >> 64;
+                const std::uint64_t r = static_cast<std::uint64_t>((bottom + (low >> 64) * d) >> 64);
+                out[i] = x < 0 ? -static_cast<std::int64_t>(r) : static_cast<std::int64_t>(r);
+            }
+#else
+            remainder<std::int64_t>(n, a, divisor, out);
+#endif
+        }
+
+        bool equal(std::size_t n, const double *a, const double *b) {
+#ifdef ELEMENTWISE_X86
+            switch (Simd::active()) {
+                case Simd::Isa::AVX512: return equalAvx512(n, a, b);
+                case Simd::Isa::AVX2: return equalAvx2(n, a, b);
+                default: break;
+            }
+#endif
+            return equalScalar(n, a, b);
+        }
+
+        Deviation worstOutside(std::size_t n, const double *a, const double *b, double absTol, double relTol) {
+#ifdef ELEMENTWISE_X86
+            switch (Simd::active()) {
+                case Simd::Isa::AVX512: return worstOutsideAvx512(n, a, b, absTol, relTol);
+                case Simd::Isa::AVX2: return worstOutsideAvx2(n, a, b, absTol, relTol);
+                default: break;
+            }
+#endif
+            return worstOutside<double>(n, a, b, absTol, relTol);
+        }
+
+        Deviation worstUlps(std::size_t n, const double *a, const double *b, std::uint64_t maxUlps) {
+#ifdef ELEMENTWISE_X86
+            switch (Simd::active()) {
+                case Simd::Isa::AVX512: return worstUlpsAvx512(n, a, b, maxUlps);
+                case Simd::Isa::AVX2: return worstUlpsAvx2(n, a, b, maxUlps);
+                default: break;
+            }
+#endif
+            return worstUlps<double>(n, a, b, maxUlps);
+        }
+    } // Elementwise
+} // Matrix
@@ -0,0 +1,231 @@
+#ifndef ELEMENTWISE_H
+#define ELEMENTWISE_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace Matrix {
+    namespace Elementwise {
+        // Loops over n contiguous elements behind the elementwise operators;
+        // out may alias any input. The templates are the plain loops used for
+        // every element type. The double overloads run explicit AVX2 or
+        // AVX-512 kernels chosen from Simd::active() and fall back to the same
+        // loops. They perform the same IEEE operations per element (a
+        // multiply and an add are never fused), so results match bit for bit.
+
+        template<typename T>
+        void add(std::size_t n, const T *a, const T *b, T *out) {
+            for (std::size_t i = 0; i < n; ++i)
+                out[i] = a[i] + b[i];
+        }
+
+        template<typename T>
+        void subtract(std::size_t n, const T *a, const T *b, T *out) {
+            for (std::size_t i = 0; i < n; ++i)
+                out[i] = a[i] - b[i];
+        }
+
+        template<typename T>
+        void multiply(std::size_t n, const T *a, const T *b, T *out) {
+            for (std::size_t i = 0; i < n; ++i)
+                out[i] = a[i] * b[i];
+        }
+
+        template<typename T>
+        void negate(std::size_t n, const T *a, T *out) {
+            for (std::size_t i = 0; i < n; ++i)
+                out[i] = -a[i];
+        }
+
+        template<typename T>
+        void scale(std::size_t n, const T *a, T scalar, T *out) {
+            for (std::size_t i = 0; i < n; ++i)
+                out[i] = a[i] * scalar;
+        }
+
+        template<typename T>
+        void divide(std::size_t n, const T *a, T scalar, T *out) {
+            for (std::size_t i = 0; i < n; ++i)
+                out[i] = a[i] / scalar;
+        }
+
+        template<typename T>
+        void addScalar(std::size_t n, const T *a, T scalar, T *out) {
+            for (std::size_t i = 0; i < n; ++i)
+                out[i] = a[i] + scalar;
+        }
+
+        template<typename T>
+        void subtractScalar(std::size_t n, const T *a, T scalar, T *out) {
+            for (std::size_t i = 0; i < n; ++i)
+                out[i] = a[i] - scalar;
+        }
+
+        // out[i] += alpha * a[i].
+        template<typename T>
+        void addScaled(std::size_t n, const T *a, T alpha, T *out) {
+            for (std::size_t i = 0; i < n; ++i)
+                out[i] += alpha * a[i];
+        }
+
+        // out[i] = a[i] % divisor with std::fmod semantics for floating types
+        // and C++ % for integers (x % -1 is 0 rather than overflowing).
+        // divisor must not be 0.
+        template<typename T>
+        void remainder(std::size_t n, const T *a, int divisor, T *out) {
+            for (std::size_t i = 0; i < n; ++i) {
+                if constexpr (std::is_integral<T>::value) {
+                    out[i] = divisor == -1 ? T(0) : static_cast<T>(a[i] % divisor);
+                } else {
+                    out[i] = std::fmod(a[i], static_cast<T>(divisor));
+                }
+            }
+        }
+
+        // True when a[i] == b[i] for every i, stopping at the first
+        // difference. Integers compare as bytes; floating types need operator==
+        // because -0 equals +0 and NaN equals nothing.
+        template<typename T>
+        bool equal(std::size_t n, const T *a, const T *b) {
+            if constexpr (std::is_integral<T>::value) {
+                return n == 0 || std::memcmp(a, b, n * sizeof(T)) == 0;
+            } else {
+                for (std::size_t i = 0; i < n; ++i)
+                    if (!(a[i] == b[i])) return false;
+                return true;
+            }
+        }
+
+        // Worst element found by the tolerance scans below: index is n when
+        // every element is within tolerance. error is |a - b| or the ULP
+        // distance, and excess how far it is past the allowance, which ranks
+        // offenders (NaN first, then the earliest on ties).
+        struct Deviation {
+            std::size_t index;
+            double error;
+            double excess;
+        };
+
+        inline void keepWorst(Deviation &worst, std::size_t index, double error, double excess) {
+            if (std::isnan(error) || std::isnan(excess)) excess = HUGE_VAL;
+            if (excess > worst.excess) worst = {index, error, excess};
+        }
+
+        // |x| as a double, for every element type.
+        template<typename T>
+        double magnitude(const T &x) {
+            if constexpr (std::is_integral<T>::value) {
+                return std::fabs(static_cast<double>(x));
+            } else {
+                return static_cast<double>(std::abs(x));
+            }
+        }
+
+        // Elements pass when a[i] == b[i] (equal infinities included) or
+        // |a[i] - b[i]| is finite and at most max(absTol, relTol *
+        // max(|a[i]|, |b[i]|)); a NaN never passes.
+        template<typename T>
+        Deviation worstOutside(std::size_t n, const T *a, const T *b, double absTol, double relTol) {
+            Deviation worst{n, 0.0, -HUGE_VAL};
+            for (std::size_t i = 0; i < n; ++i) {
+                if (a[i] == b[i]) continue;
+                double error;
+                if constexpr (std::is_integral<T>::value) {
+                    error = std::fabs(static_cast<double>(a[i]) - static_cast<double>(b[i]));
+                } else {
+                    error = magnitude(a[i] - b[i]);
+                }
+                const double allowed = std::max(absTol, relTol * std::max(magnitude(a[i]), magnitude(b[i])));
+                if (!(error <= allowed) || error == HUGE_VAL) keepWorst(worst, i, error, error - allowed);
+            }
+            return worst;
+        }
+
+        // Representable values between x and y: |x - y| for integers, and
+        // for float and double the distance between their bit patterns read
+        // as sign-magnitude integers, so -0 and +0 are 0 apart. The maximum
+        // when either is NaN.
+        template<typename T>
+        std::uint64_t ulpDistance(T x, T y) {
+            if constexpr (std::is_integral<T>::value) {
+                const auto ux = static_cast<std::uint64_t>(x), uy = static_cast<std::uint64_t>(y);
+                return x < y ? uy - ux : ux - uy;
+            } else {
+                static_assert(sizeof(T) == 4 || sizeof(T) == 8, "ULP distance needs float or double");
+                if (x != x || y != y) return std::numeric_limits<std::uint64_t>::max();
+                using Bits = typename std::conditional<sizeof(T) == 8, std::int64_t, std::int32_t>::type;
+                Bits bx, by;
+                std::memcpy(&bx, &x, sizeof x);
+                std::memcpy(&by, &y, sizeof y);
+                const std::int64_t ox = bx < 0 ? std::numeric_limits<Bits>::min() - bx : bx;
+                const std::int64_t oy = by < 0 ? std::numeric_limits<Bits>::min() - by : by;
+                return ox < oy ? static_cast<std::uint64_t>(oy) - static_cast<std::uint64_t>(ox)
+                               : static_cast<std::uint64_t>(ox) - static_cast<std::uint64_t>(oy);
+            }
+        }
+
+        // Elements pass when ulpDistance(a[i], b[i]) <= maxUlps.
+        template<typename T>
+        Deviation worstUlps(std::size_t n, const T *a, const T *b, std::uint64_t maxUlps) {
+            Deviation worst{n, 0.0, -HUGE_VAL};
+            for (std::size_t i = 0; i < n; ++i) {
+                const std::uint64_t distance = ulpDistance(a[i], b[i]);
+                if (distance <= maxUlps) continue;
+                const bool nan = !std::is_integral<T>::value && (a[i] != a[i] || b[i] != b[i]);
+                keepWorst(worst, i, nan ? NAN : static_cast<double>(distance),
+                          static_cast<double>(distance - maxUlps));
+            }
+            return worst;
+        }
+
+        void add(std::size_t n, const double *a, const double *b, double *out);
+
+        void subtract(std::size_t n, const double *a, const double *b, double *out);
+
+        void multiply(std::size_t n, const double *a, const double *b, double *out);
+
+        void negate(std::size_t n, const double *a, double *out);
+
+        void scale(std::size_t n, const double *a, double scalar, double *out);
+
+        void divide(std::size_t n, const double *a, double scalar, double *out);
+
+        void addScalar(std::size_t n, const double *a, double scalar, double *out);
+
+        void subtractScalar(std::size_t n, const double *a, double scalar, double *out);
+
+        void addScaled(std::size_t n, const double *a, double alpha, double *out);
+
+        // Eight (AVX2) or sixteen (AVX-512) floats per step; the float
+        // matrix product is built on it.
+        void addScaled(std::size_t n, const float *a, float alpha, float *out);
+
+        // Bit-for-bit std::fmod: a truncated quotient and one fused
+        // multiply-subtract per element, with a correction when the rounded
+        // quotient overshoots. Elements of magnitude 2^52 and up, infinities
+        // and NaNs go through std::fmod itself.
+        void remainder(std::size_t n, const double *a, int divisor, double *out);
+
+        // Compares 16 elements per step and exits after the first step with
+        // a difference.
+        bool equal(std::size_t n, const double *a, const double *b);
+
+        // Test blocks of 8 (AVX2) or 16 (AVX-512) elements at once and only
+        // rescan, with the loops above, the blocks holding an offender.
+        Deviation worstOutside(std::size_t n, const double *a, const double *b, double absTol, double relTol);
+
+        Deviation worstUlps(std::size_t n, const double *a, const double *b, std::uint64_t maxUlps);
+
+        // Divides by the invariant |divisor| with a precomputed 128-bit
+        // reciprocal (two multiplications instead of a hardware division).
+        void remainder(std::size_t n, const std::int64_t *a, int divisor, std::int64_t *out);
+    } // Elementwise
+} // Matrix
+
+#endif //ELEMENTWISE_H
@@ -0,0 +1,225 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <cstddef>
+#include <type_traits>
+#include "SquareMat.h"
+
+namespace Matrix {
+    // Lazy elementwise expressions. Wrapping an operand with lazy() makes
+    // +, -, unary -, * / by a scalar and Hadamard % build an expression tree
+    // instead of a SquareMat; the whole tree is evaluated in a single loop
+    // when it is assigned to (or used to construct) a SquareMat, e.g.
+    //
+    //     W = lazy(A) + B - lazy(C) * 2.0;
+    //
+    // Plain SquareMat operators stay eager: in lazy(A) + B - C * 2.0 the
+    // product C * 2.0 is still materialized before the fused pass.
+    // Expressions refer to their SquareMat operands, so they must not outlive
+    // them; evaluate them in the statement that builds them.
+    namespace Expr {
+        template<typename E>
+        class Expression {
+        public:
+            const E &self() const {
+                return static_cast<const E &>(*this);
+            }
+        };
+
+        class Leaf : public Expression<Leaf> {
+        private:
+            const double *data;
+            int n;
+
+        public:
+            explicit Leaf(const SquareMat &mat): data(mat.raw()), n(mat.getSize()) {
+            }
+
+            int size() const {
+                return n;
+            }
+
+            double operator[](std::size_t i) const {
+                return data[i];
+            }
+        };
+
+        struct Add {
+            static double apply(double a, double b) { return a + b; }
+        };
+
+        struct Subtract {
+            static double apply(double a, double b) { return a - b; }
+        };
+
+        struct Hadamard {
+            static double apply(double a, double b) { return a * b; }
+        };
+
+        template<typename Op, typename L, typename R>
+        class Binary : public Expression<Binary<Op, L, R> > {
+        private:
+            L left;
+            R right;
+
+        public:
+            Binary(const L &left, const R &right): left(left), right(right) {
+                if (left.size() != right.size()) throw SizeMismatch();
+            }
+
+            int size() const {
+                return left.size();
+            }
+
+            double operator[](std::size_t i) const {
+                return Op::apply(left[i], right[i]);
+            }
+        };
+
+        template<typename E>
+        class Negate : public Expression<Negate<E> > {
+        private:
+            E operand;
+
+        public:
+            explicit Negate(const E &operand): operand(operand) {
+            }
+
+            int size() const {
+                return operand.size();
+            }
+
+            double operator[](std::size_t i) const {
+                return -operand[i];
+            }
+        };
+
+        template<typename E>
+        class Scale : public Expression<Scale<E> > {
+        private:
+            E operand;
+            double scalar;
+
+        public:
+            Scale(const E &operand, double scalar): operand(operand), scalar(scalar) {
+            }
+
+            int size() const {
+                return operand.size();
+            }
+
+            double operator[](std::size_t i) const {
+                return operand[i] * scalar;
+            }
+        };
+
+        template<typename E>
+        class Divide : public Expression<Divide<E> > {
+        private:
+            E operand;
+            double scalar;
+
+        public:
+            Divide(const E &operand, double scalar): operand(operand), scalar(scalar) {
+                if (scalar == 0) throw DivisionByZero();
+            }
+
+            int size() const {
+                return operand.size();
+            }
+
+            double operator[](std::size_t i) const {
+                return operand[i] / scalar;
+            }
+        };
+
+        inline Leaf wrap(const SquareMat &mat) {
+            return Leaf(mat);
+        }
+
+        template<typename E>
+        const E &wrap(const Expression<E> &expr) {
+            return expr.self();
+        }
+
+        template<typename T>
+        using Node = typename std::decay<decltype(wrap(std::declval<const T &>()))>::type;
+
+        template<typename T>
+        constexpr bool isExpression = std::is_base_of<Expression<T>, T>::value;
+
+        // Binary operators apply when one side is an expression and the other
+        // an expression or a SquareMat.
+        template<typename L, typename R>
+        using EnableBinary = typename std::enable_if<
+            (isExpression<L> || isExpression<R>) &&
+            (isExpression<L> || std::is_same<L, SquareMat>::value) &&
+            (isExpression<R> || std::is_same<R, SquareMat>::value)>::type;
+
+        template<typename L, typename R, typename = EnableBinary<L, R> >
+        Binary<Add, Node<L>, Node<R> > operator+(const L &left, const R &right) {
+            return Binary<Add, Node<L>, Node<R> >(wrap(left), wrap(right));
+        }
+
+        template<typename L, typename R, typename = EnableBinary<L, R> >
+        Binary<Subtract, Node<L>, Node<R> > operator-(const L &left, const R &right) {
+            return Binary<Subtract, Node<L>, Node<R> >(wrap(left), wrap(right));
+        }
+
+        template<typename L, typename R, typename = EnableBinary<L, R> >
+        Binary<Hadamard, Node<L>, Node<R> > operator%(const L &left, const R &right) {
+            return Binary<Hadamard, Node<L>, Node<R> >(wrap(left), wrap(right));
+        }
+
+        template<typename E>
+        Negate<E> operator-(const Expression<E> &expr) {
+            return Negate<E>(expr.self());
+        }
+
+        template<typename E>
+        Scale<E> operator*(const Expression<E> &expr, double scalar) {
+            return Scale<E>(expr.self(), scalar);
+        }
+
+        template<typename E>
+        Scale<E> operator*(double scalar, const Expression<E> &expr) {
+            return Scale<E>(expr.self(), scalar);
+        }
+
+        template<typename E>
+        Divide<E> operator/(const Expression<E> &expr, double scalar) {
+            return Divide<E>(expr.self(), scalar);
+        }
+    } // Expr
+
+    inline Expr::Leaf lazy(const SquareMat &mat) {
+        return Expr::Leaf(mat);
+    }
+
+    template<typename T>
+    template<typename E>
+    BasicSquareMat<T>::BasicSquareMat(const Expr::Expression<E> &expr): BasicSquareMat(expr.self().size()) {
+        const E &e = expr.self();
+        const std::size_t n = elements();
+        for (std::size_t i = 0; i < n; ++i)
+            data[i] = e[i];
+    }
+
+    // Each element of the result depends only on the same element of the
+    // operands, so the target may appear in the expression itself.
+    template<typename T>
+    template<typename E>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator=(const Expr::Expression<E> &expr) {
+        const E &e = expr.self();
+        if (e.size() != size) {
+            return *this = BasicSquareMat(expr);
+        }
+        touch();
+        const std::size_t n = elements();
+        for (std::size_t i = 0; i < n; ++i)
+            data[i] = e[i];
+        return *this;
+    }
+} // Matrix
+
+#endif //EXPR_H
@@ -0,0 +1,325 @@
+#ifndef FIXEDSQUAREMAT_H
+#define FIXEDSQUAREMAT_H
+
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+#include <iostream>
+#include "Exceptions.h"
+#include "SquareMat.h"
+
+namespace Matrix {
+    // N x N matrix with inline storage and the same operators as SquareMat,
+    // for small transforms that should never touch the heap. Everything except
+    // operator%(int) (std::fmod) and stream output is constexpr; all loops
+    // have compile-time trip counts, so the compiler unrolls them for small N.
+    template<int N>
+    class FixedSquareMat {
+        static_assert(N > 0, "FixedSquareMat needs a positive size");
+
+    private:
+        double data[N * N];
+
+        static constexpr double abs(double value) {
+            return value < 0 ? -value : value;
+        }
+
+        constexpr FixedSquareMat<N - 1> minor(int skipRow, int skipCol) const {
+            FixedSquareMat<N - 1> result;
+            for (int i = 0, r = 0; i < N; ++i) {
+                if (i == skipRow) continue;
+                for (int j = 0, c = 0; j < N; ++j) {
+                    if (j == skipCol) continue;
+                    result(r, c++) = (*this)(i, j);
+                }
+                ++r;
+            }
+            return result;
+        }
+
+        // Gaussian elimination with partial pivoting on a copy.
+        constexpr double eliminationDet() const {
+            FixedSquareMat lu(*this);
+            double det = 1;
+            for (int k = 0; k < N; ++k) {
+                int pivot = k;
+                for (int i = k + 1; i < N; ++i) {
+                    if (abs(lu(i, k)) > abs(lu(pivot, k))) pivot = i;
+                }
+                if (lu(pivot, k) == 0) return 0;
+                if (pivot != k) {
+                    for (int j = 0; j < N; ++j) {
+                        const double tmp = lu(k, j);
+                        lu(k, j) = lu(pivot, j);
+                        lu(pivot, j) = tmp;
+                    }
+                    det = -det;
+                }
+                det *= lu(k, k);
+                for (int i = k + 1; i < N; ++i) {
+                    const double factor = lu(i, k) / lu(k, k);
+                    for (int j = k + 1; j < N; ++j) {
+                        lu(i, j) -= factor * lu(k, j);
+                    }
+                }
+            }
+            return det;
+        }
+
+    public:
+        constexpr FixedSquareMat(): data{} {
+        }
+
+        // Row-major values; throws SizeMismatch unless exactly N * N are given.
+        constexpr FixedSquareMat(std::initializer_list<double> values): data{} {
+            if (values.size() != static_cast<std::size_t>(N) * N) throw SizeMismatch();
+            int i = 0;
+            for (double value : values) {
+                data[i++] = value;
+            }
+        }
+
+        explicit FixedSquareMat(const SquareMat &other): data{} {
+            if (other.getSize() != N) throw SizeMismatch();
+            for (int i = 0; i < N * N; ++i) {
+                data[i] = other.raw()[i];
+            }
+        }
+
+        explicit operator SquareMat() const {
+            SquareMat result(N);
+            for (int i = 0; i < N * N; ++i) {
+                result(i / N, i % N) = data[i];
+            }
+            return result;
+        }
+
+        static constexpr FixedSquareMat identity() {
+            FixedSquareMat result;
+            for (int i = 0; i < N; ++i) {
+                result(i, i) = 1;
+            }
+            return result;
+        }
+
+        static constexpr int getSize() {
+            return N;
+        }
+
+        constexpr double *operator[](int row) {
+            if (row < 0 || row >= N) throw InvalidOperation();
+            return data + row * N;
+        }
+
+        constexpr const double *operator[](int row) const {
+            if (row < 0 || row >= N) throw InvalidOperation();
+            return data + row * N;
+        }
+
+        constexpr double &operator()(int row, int col) {
+            return data[row * N + col];
+        }
+
+        constexpr double operator()(int row, int col) const {
+            return data[row * N + col];
+        }
+
+        constexpr FixedSquareMat operator+(const FixedSquareMat &other) const {
+            FixedSquareMat result(*this);
+            return result += other;
+        }
+
+        constexpr FixedSquareMat operator-(const FixedSquareMat &other) const {
+            FixedSquareMat result(*this);
+            return result -= other;
+        }
+
+        constexpr FixedSquareMat operator*(const FixedSquareMat &other) const {
+            FixedSquareMat result;
+            for (int i = 0; i < N; ++i)
+                for (int k = 0; k < N; ++k)
+                    for (int j = 0; j < N; ++j)
+                        result(i, j) += (*this)(i, k) * other(k, j);
+            return result;
+        }
+
+        constexpr FixedSquareMat operator*(double scalar) const {
+            FixedSquareMat result(*this);
+            return result *= scalar;
+        }
+
+        constexpr FixedSquareMat operator%(const FixedSquareMat &other) const {
+            FixedSquareMat result(*this);
+            return result %= other;
+        }
+
+        FixedSquareMat operator%(int scalar) const {
+            FixedSquareMat result(*this);
+            return result %= scalar;
+        }
+
+        constexpr FixedSquareMat operator/(double scalar) const {
+            FixedSquareMat result(*this);
+            return result /= scalar;
+        }
+
+        constexpr FixedSquareMat operator^(int exp) const {
+            if (exp < 0) throw InvalidOperation();
+            FixedSquareMat res = identity();
+            FixedSquareMat base(*this);
+            while (exp > 0) {
+                if (exp & 1) res = res * base;
+                exp >>= 1;
+                if (exp > 0) base = base * base;
+            }
+            return res;
+        }
+
+        constexpr FixedSquareMat operator-() const {
+            FixedSquareMat result;
+            for (int i = 0; i < N * N; ++i)
+                result.data[i] = -data[i];
+            return result;
+        }
+
+        constexpr FixedSquareMat &operator+=(const FixedSquareMat &other) {
+            for (int i = 0; i < N * N; ++i)
+                data[i] += other.data[i];
+            return *this;
+        }
+
+        constexpr FixedSquareMat &operator-=(const FixedSquareMat &other) {
+            for (int i = 0; i < N * N; ++i)
+                data[i] -= other.data[i];
+            return *this;
+        }
+
+        constexpr FixedSquareMat &operator*=(const FixedSquareMat &other) {
+            return *this = *this * other;
+        }
+
+        constexpr FixedSquareMat &operator*=(double scalar) {
+            for (int i = 0; i < N * N; ++i)
+                data[i] *= scalar;
+            return *this;
+        }
+
+        constexpr FixedSquareMat &operator%=(const FixedSquareMat &other) {
+            for (int i = 0; i < N * N; ++i)
+                data[i] *= other.data[i];
+            return *this;
+        }
+
+        FixedSquareMat &operator%=(int scalar) {
+            if (scalar == 0) throw DivisionByZero();
+            for (int i = 0; i < N * N; ++i)
+                data[i] = std::fmod(data[i], scalar);
+            return *this;
+        }
+
+        constexpr FixedSquareMat &operator/=(double scalar) {
+            if (scalar == 0) throw DivisionByZero();
+            for (int i = 0; i < N * N; ++i)
+                data[i] /= scalar;
+            return *this;
+        }
+
+        constexpr FixedSquareMat &operator++() {
+            for (int i = 0; i < N * N; ++i)
+                ++data[i];
+            return *this;
+        }
+
+        constexpr FixedSquareMat operator++(int) {
+            FixedSquareMat tmp(*this);
+            ++(*this);
+            return tmp;
+        }
+
+        constexpr FixedSquareMat &operator--() {
+            for (int i = 0; i < N * N; ++i)
+                --data[i];
+            return *this;
+        }
+
+        constexpr FixedSquareMat operator--(int) {
+            FixedSquareMat tmp(*this);
+            --(*this);
+            return tmp;
+        }
+
+        constexpr FixedSquareMat operator~() const {
+            FixedSquareMat result;
+            for (int i = 0; i < N; ++i)
+                for (int j = 0; j < N; ++j)
+                    result(i, j) = (*this)(j, i);
+            return result;
+        }
+
+        // Closed-form cofactor expansion up to 4x4, elimination beyond.
+        constexpr double operator!() const {
+            if constexpr (N == 1) {
+                return data[0];
+            } else if constexpr (N == 2) {
+                return data[0] * data[3] - data[1] * data[2];
+            } else if constexpr (N <= 4) {
+                double det = 0;
+                for (int j = 0; j < N; ++j) {
+                    const double term = data[j] * !minor(0, j);
+                    det += j % 2 ? -term : term;
+                }
+                return det;
+            } else {
+                return eliminationDet();
+            }
+        }
+
+        constexpr bool operator==(const FixedSquareMat &other) const {
+            for (int i = 0; i < N * N; ++i)
+                if (data[i] != other.data[i]) return false;
+            return true;
+        }
+
+        constexpr bool operator!=(const FixedSquareMat &other) const {
+            return !(*this == other);
+        }
+
+        constexpr bool operator<(const FixedSquareMat &other) const {
+            double sum1 = 0, sum2 = 0;
+            for (int i = 0; i < N * N; ++i) {
+                sum1 += data[i];
+                sum2 += other.data[i];
+            }
+            return sum1 < sum2;
+        }
+
+        constexpr bool operator<=(const FixedSquareMat &other) const {
+            return *this < other || *this == other;
+        }
+
+        constexpr bool operator>(const FixedSquareMat &other) const {
+            return !(*this <= other);
+        }
+
+        constexpr bool operator>=(const FixedSquareMat &other) const {
+            return !(*this < other);
+        }
+
+        friend constexpr FixedSquareMat operator*(double scalar, const FixedSquareMat &mat) {
+            return mat * scalar;
+        }
+
+        friend std::ostream &operator<<(std::ostream &out, const FixedSquareMat &mat) {
+            for (int i = 0; i < N; ++i) {
+                for (int j = 0; j < N; ++j) {
+                    out << mat(i, j);
+                    if (j < N - 1) out << " ";
+                }
+                out << "\n";
+            }
+            return out;
+        }
+    };
+} // Matrix
+
+#endif //FIXEDSQUAREMAT_H
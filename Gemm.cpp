@@ -0,0 +1,441 @@
+#include "Gemm.h"
+#include "Exceptions.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+namespace Matrix {
+    namespace Gemm {
+        namespace {
+            // Cache blocks: an MC x KC panel of A stays in L2, a KC x NC panel
+            // of B in L3. MC and NC are multiples of every kernel's MR and NR.
+            constexpr int MC = 120;
+            constexpr int KC = 256;
+            constexpr int NC = 2048;
+            constexpr int MaxTile = 6 * 16;
+            constexpr std::size_t Alignment = 64;
+
+            // C[mr x nr] += A sliver * B sliver, for one register block.
+            using MicroKernel = void (*)(int kc, const double *a, const double *b, double *c, int ldc);
+
+            struct Kernel {
+                int mr;
+                int nr;
+                MicroKernel run;
+            };
+
+            // Packing buffers are reused across calls on the same thread. The B
+            // panel grows to the largest one this thread has packed, so pool
+            // workers, which only see ParallelTile-wide panels, never hold a
+            // full KC x NC buffer.
+            struct Scratch {
+                double *packedA = nullptr;
+                double *packedB = nullptr;
+                std::size_t capacityB = 0;
+
+                Scratch() {
+                    packedA = static_cast<double *>(::operator new[](sizeof(double) * MC * KC,
+                                                                     std::align_val_t(Alignment)));
+                }
+
+                double *panelB(std::size_t elements) {
+                    if (elements > capacityB) {
+                        double *grown = static_cast<double *>(::operator new[](sizeof(double) * elements,
+                                                                               std::align_val_t(Alignment)));
+                        ::operator delete[](packedB, std::align_val_t(Alignment));
+                        packedB = grown;
+                        capacityB = elements;
+                    }
+                    return packedB;
+                }
+
+                ~Scratch() {
+                    ::operator delete[](packedA, std::align_val_t(Alignment));
+                    ::operator delete[](packedB, std::align_val_t(Alignment));
+                }
+
+                Scratch(const Scratch &) = delete;
+
+                Scratch &operator=(const Scratch &) = delete;
+            };
+
+            Scratch &scratch() {
+                thread_local Scratch buffers;
+                return buffers;
+            }
+
+            // An operand as the kernels see it: element (i, j) is data[i * ld + j],
+            // or data[j * ld + i] when the stored buffer is read transposed.
+            struct Operand {
+                const double *data;
+                int ld;
+                Layout layout;
+
+                double at(int i, int j) const {
+                    return layout == Layout::Normal ? data[static_cast<std::size_t>(i) * ld + j]
+                                                    : data[static_cast<std::size_t>(j) * ld + i];
+                }
+
+                // The operand whose (0, 0) is this one's (i, j).
+                Operand from(int i, int j) const {
+                    return {layout == Layout::Normal ? data + static_cast<std::size_t>(i) * ld + j
+                                                     : data + static_cast<std::size_t>(j) * ld + i,
+                            ld, layout};
+                }
+            };
+
+            // Copies an mc x kc block of A into mr-row slivers stored column by
+            // column, zero padding the last sliver. A transposed A is read along
+            // its stored rows, which is exactly the sliver order.
+            void packA(int mc, int kc, int mr, const Operand &a, double *packed) {
+                for (int i = 0; i < mc; i += mr) {
+                    const int rows = std::min(mr, mc - i);
+                    for (int k = 0; k < kc; ++k) {
+                        if (a.layout == Layout::Transposed) {
+                            const double *column = a.data + static_cast<std::size_t>(k) * a.ld + i;
+                            for (int r = 0; r < mr; ++r) {
+                                *packed++ = r < rows ? column[r] : 0.0;
+                            }
+                            continue;
+                        }
+                        for (int r = 0; r < mr; ++r) {
+                            *packed++ = r < rows ? a.data[static_cast<std::size_t>(i + r) * a.ld + k] : 0.0;
+                        }
+                    }
+                }
+            }
+
+            // Copies a kc x nc block of B into nr-column slivers stored row by
+            // row, zero padding the last sliver.
+            void packB(int kc, int nc, int nr, const Operand &b, double *packed) {
+                for (int j = 0; j < nc; j += nr) {
+                    const int cols = std::min(nr, nc - j);
+                    for (int k = 0; k < kc; ++k) {
+                        if (b.layout == Layout::Transposed) {
+                            const double *column = b.data + static_cast<std::size_t>(j) * b.ld + k;
+                            for (int col = 0; col < nr; ++col) {
+                                *packed++ = col < cols ? column[static_cast<std::size_t>(col) * b.ld] : 0.0;
+                            }
+                            continue;
+                        }
+                        const double *row = b.data + static_cast<std::size_t>(k) * b.ld + j;
+                        for (int col = 0; col < nr; ++col) {
+                            *packed++ = col < cols ? row[col] : 0.0;
+                        }
+                    }
+                }
+            }
+
+            void microKernelScalar(int kc, const double *a, const double *b, double *c, int ldc) {
+                constexpr int MR = 4;
+                constexpr int NR = 8;
+                double acc[MR][NR] = {};
+                for (int k = 0; k < kc; ++k) {
+                    for (int r = 0; r < MR; ++r) {
+                        const double ar = a[k * MR + r];
+                        for (int col = 0; col < NR; ++col) {
+                            acc[r][col] += ar * b[k * NR + col];
+                        }
+                    }
+                }
+                for (int r = 0; r < MR; ++r) {
+                    for (int col = 0; col < NR; ++col) {
+                        c[static_cast<std::size_t>(r) * ldc + col] += acc[r][col];
+                    }
+                }
+            }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+            __attribute__((target("sse2")))
+            void microKernelSse2(int kc, const double *a, const double *b, double *c, int ldc) {
+                constexpr int MR = 4;
+                constexpr int NR = 4;
+                __m128d acc[MR][2];
+                for (int r = 0; r < MR; ++r) {
+                    acc[r][0] = _mm_setzero_pd();
+                    acc[r][1] = _mm_setzero_pd();
+                }
+                for (int k = 0; k < kc; ++k) {
+                    const __m128d b0 = _mm_loadu_pd(b + k * NR);
+                    const __m128d b1 = _mm_loadu_pd(b + k * NR + 2);
+                    for (int r = 0; r < MR; ++r) {
+                        const __m128d ar = _mm_set1_pd(a[k * MR + r]);
+                        acc[r][0] = _mm_add_pd(acc[r][0], _mm_mul_pd(ar, b0));
+                        acc[r][1] = _mm_add_pd(acc[r][1], _mm_mul_pd(ar, b1));
+                    }
+                }
+                for (int r = 0; r < MR; ++r) {
+                    double *row = c + static_cast<std::size_t>(r) * ldc;
+                    _mm_storeu_pd(row, _mm_add_pd(_mm_loadu_pd(row), acc[r][0]));
+                    _mm_storeu_pd(row + 2, _mm_add_pd(_mm_loadu_pd(row + 2), acc[r][1]));
+                }
+            }
+
+            __attribute__((target("avx2,fma")))
+            void microKernelAvx2(int kc, const double *a, const double *b, double *c, int ldc) {
+                constexpr int MR = 6;
+                constexpr int NR = 8;
+                __m256d acc[MR][2];
+                for (int r = 0; r < MR; ++r) {
+                    acc[r][0] = _mm256_setzero_pd();
+                    acc[r][1] = _mm256_setzero_pd();
+                }
+                for (int k = 0; k < kc; ++k) {
+                    const __m256d b0 = _mm256_loadu_pd(b + k * NR);
+                    const __m256d b1 = _mm256_loadu_pd(b + k * NR + 4);
+                    for (int r = 0; r < MR; ++r) {
+                        const __m256d ar = _mm256_broadcast_sd(a + k * MR + r);
+                        acc[r][0] = _mm256_fmadd_pd(ar, b0, acc[r][0]);
+                        acc[r][1] = _mm256_fmadd_pd(ar, b1, acc[r][1]);
+                    }
+                }
+                for (int r = 0; r < MR; ++r) {
+                    double *row = c + static_cast<std::size_t>(r) * ldc;
+                    _mm256_storeu_pd(row, _mm256_add_pd(_mm256_loadu_pd(row), acc[r][0]));
+                    _mm256_storeu_pd(row + 4, _mm256_add_pd(_mm256_loadu_pd(row + 4), acc[r][1]));
+                }
+            }
+
+            __attribute__((target("avx512f")))
+            void microKernelAvx512(int kc, const double *a, const double *b, double *c, int ldc) {
+                constexpr int MR = 6;
+                constexpr int NR = 16;
+                __m512d acc[MR][2];
+                for (int r = 0; r < MR; ++r) {
+                    acc[r][0] = _mm512_setzero_pd();
+                    acc[r][1] = _mm512_setzero_pd();
+                }
+                for (int k = 0; k < kc; ++k) {
+                    const __m512d b0 = _mm512_loadu_pd(b + k * NR);
+                    const __m512d b1 = _mm512_loadu_pd(b + k * NR + 8);
+                    for (int r = 0; r < MR; ++r) {
+                        const __m512d ar = _mm512_set1_pd(a[k * MR + r]);
+                        acc[r][0] = _mm512_fmadd_pd(ar, b0, acc[r][0]);
+                        acc[r][1] = _mm512_fmadd_pd(ar, b1, acc[r][1]);
+                    }
+                }
+                for (int r = 0; r < MR; ++r) {
+                    double *row = c + static_cast<std::size_t>(r) * ldc;
+                    _mm512_storeu_pd(row, _mm512_add_pd(_mm512_loadu_pd(row), acc[r][0]));
+                    _mm512_storeu_pd(row + 8, _mm512_add_pd(_mm512_loadu_pd(row + 8), acc[r][1]));
+                }
+            }
+#endif
+
+            Kernel kernelFor(Simd::Isa isa) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+                switch (isa) {
+                    case Simd::Isa::AVX512: return {6, 16, microKernelAvx512};
+                    case Simd::Isa::AVX2: return {6, 8, microKernelAvx2};
+                    case Simd::Isa::SSE2: return {4, 4, microKernelSse2};
+                    default: break;
+                }
+#endif
+                return {4, 8, microKernelScalar};
+            }
+
+            void macroKernel(const Kernel &kernel, int mc, int nc, int kc, const double *packedA,
+                             const double *packedB, double *c, int ldc) {
+                const int mr = kernel.mr;
+                const int nr = kernel.nr;
+                for (int j = 0; j < nc; j += nr) {
+                    const int cols = std::min(nr, nc - j);
+                    for (int i = 0; i < mc; i += mr) {
+                        const int rows = std::min(mr, mc - i);
+                        double *block = c + static_cast<std::size_t>(i) * ldc + j;
+                        if (rows == mr && cols == nr) {
+                            kernel.run(kc, packedA + i * kc, packedB + j * kc, block, ldc);
+                            continue;
+                        }
+                        double edge[MaxTile] = {};
+                        kernel.run(kc, packedA + i * kc, packedB + j * kc, edge, nr);
+                        for (int r = 0; r < rows; ++r) {
+                            for (int col = 0; col < cols; ++col) {
+                                block[static_cast<std::size_t>(r) * ldc + col] += edge[r * nr + col];
+                            }
+                        }
+                    }
+                }
+            }
+
+            void clear(int m, int n, double *c, int ldc) {
+                for (int i = 0; i < m; ++i) {
+                    std::fill(c + static_cast<std::size_t>(i) * ldc,
+                              c + static_cast<std::size_t>(i) * ldc + n, 0.0);
+                }
+            }
+
+            // C[m x n] = A[m x k] * B[k x n] through the packed kernel.
+            void blockedRange(int m, int n, int k, const Kernel &kernel, const Operand &a, const Operand &b,
+                              double *c, int ldc) {
+                clear(m, n, c, ldc);
+                Scratch &buffers = scratch();
+                for (int jc = 0; jc < n; jc += NC) {
+                    const int nc = std::min(NC, n - jc);
+                    for (int pc = 0; pc < k; pc += KC) {
+                        const int kc = std::min(KC, k - pc);
+                        const int paddedNc = (nc + kernel.nr - 1) / kernel.nr * kernel.nr;
+                        double *packedB = buffers.panelB(static_cast<std::size_t>(kc) * paddedNc);
+                        packB(kc, nc, kernel.nr, b.from(pc, jc), packedB);
+                        for (int ic = 0; ic < m; ic += MC) {
+                            const int mc = std::min(MC, m - ic);
+                            packA(mc, kc, kernel.mr, a.from(ic, pc), buffers.packedA);
+                            macroKernel(kernel, mc, nc, kc, buffers.packedA, packedB,
+                                        c + static_cast<std::size_t>(ic) * ldc + jc, ldc);
+                        }
+                    }
+                }
+            }
+
+            // i-k-j loop that streams rows of B, or dot products of rows when B
+            // is transposed; both sum over k in the same order as naive().
+            void simpleRange(int n, const Operand &a, const Operand &b, double *c, int ldc) {
+                for (int i = 0; i < n; ++i) {
+                    double *row = c + static_cast<std::size_t>(i) * ldc;
+                    if (b.layout == Layout::Transposed) {
+                        for (int j = 0; j < n; ++j) {
+                            const double *bColumn = b.data + static_cast<std::size_t>(j) * b.ld;
+                            double sum = 0;
+                            for (int k = 0; k < n; ++k) {
+                                sum += a.at(i, k) * bColumn[k];
+                            }
+                            row[j] = sum;
+                        }
+                        continue;
+                    }
+                    std::fill(row, row + n, 0.0);
+                    for (int k = 0; k < n; ++k) {
+                        const double aik = a.at(i, k);
+                        const double *bRow = b.data + static_cast<std::size_t>(k) * b.ld;
+                        for (int j = 0; j < n; ++j) {
+                            row[j] += aik * bRow[j];
+                        }
+                    }
+                }
+            }
+
+            int hardwareThreads() {
+                const int threads = static_cast<int>(std::thread::hardware_concurrency());
+                return threads > 0 ? threads : 1;
+            }
+
+            std::atomic<int> &threadSetting() {
+                static std::atomic<int> threads(hardwareThreads());
+                return threads;
+            }
+
+            struct SharedPool {
+                std::mutex mutex;
+                std::shared_ptr<ThreadPool> pool;
+            };
+
+            SharedPool &sharedPool() {
+                static SharedPool shared;
+                return shared;
+            }
+
+            // Shared pool, replaced by a larger one when a call asks for more
+            // threads than it has. The caller thread always takes part, hence
+            // threads - 1. Callers hold the pool for their whole loop, so a
+            // replaced pool lives until the last loop running on it is done.
+            std::shared_ptr<ThreadPool> pool(int threads) {
+                SharedPool &shared = sharedPool();
+                std::lock_guard<std::mutex> lock(shared.mutex);
+                if (!shared.pool || shared.pool->workers() < threads - 1) {
+                    shared.pool = std::make_shared<ThreadPool>(threads - 1);
+                }
+                return shared.pool;
+            }
+
+            void parallelRange(int n, const Operand &a, const Operand &b, double *c, int ldc, int threads) {
+                const int tiles = (n + ParallelTile - 1) / ParallelTile;
+                // The pool outlives the call, so it is never grown past the
+                // hardware or past one thread per tile.
+                threads = std::min({threads, hardwareThreads(), tiles * tiles});
+                const Kernel kernel = kernelFor(Simd::active());
+                const std::function<void(int)> task = [&](int tile) {
+                    const int i0 = tile / tiles * ParallelTile;
+                    const int j0 = tile % tiles * ParallelTile;
+                    blockedRange(std::min(ParallelTile, n - i0), std::min(ParallelTile, n - j0), n, kernel,
+                                 a.from(i0, 0), b.from(0, j0), c + static_cast<std::size_t>(i0) * ldc + j0, ldc);
+                };
+                const std::shared_ptr<ThreadPool> workers = pool(threads);
+                workers->parallelFor(tiles * tiles, threads, task);
+            }
+        }
+
+        void multiply(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc) {
+            multiply(n, a, lda, b, ldb, c, ldc, threadCount());
+        }
+
+        void multiply(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc,
+                      int threads) {
+            multiply(n, Layout::Normal, a, lda, Layout::Normal, b, ldb, c, ldc, threads);
+        }
+
+        void multiply(int n, Layout layoutA, const double *a, int lda, Layout layoutB, const double *b, int ldb,
+                      double *c, int ldc, int threads) {
+            const Operand opA{a, lda, layoutA};
+            const Operand opB{b, ldb, layoutB};
+            if (n < BlockedThreshold) {
+                simpleRange(n, opA, opB, c, ldc);
+            } else if (n < ParallelThreshold || threads <= 1) {
+                blockedRange(n, n, n, kernelFor(Simd::active()), opA, opB, c, ldc);
+            } else {
+                parallelRange(n, opA, opB, c, ldc, threads);
+            }
+        }
+
+        void naive(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc) {
+            for (int i = 0; i < n; ++i) {
+                for (int j = 0; j < n; ++j) {
+                    double sum = 0;
+                    for (int k = 0; k < n; ++k) {
+                        sum += a[static_cast<std::size_t>(i) * lda + k] * b[static_cast<std::size_t>(k) * ldb + j];
+                    }
+                    c[static_cast<std::size_t>(i) * ldc + j] = sum;
+                }
+            }
+        }
+
+        void simple(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc) {
+            simpleRange(n, {a, lda, Layout::Normal}, {b, ldb, Layout::Normal}, c, ldc);
+        }
+
+        void blocked(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc) {
+            blockedRange(n, n, n, kernelFor(Simd::active()), {a, lda, Layout::Normal}, {b, ldb, Layout::Normal},
+                         c, ldc);
+        }
+
+        void parallel(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc,
+                      int threads) {
+            parallelRange(n, {a, lda, Layout::Normal}, {b, ldb, Layout::Normal}, c, ldc, threads);
+        }
+
+        void setThreadCount(int threads) {
+            if (threads < 0) throw InvalidOperation();
+            threadSetting().store(threads == 0 ? hardwareThreads() : threads);
+        }
+
+        int threadCount() {
+            return threadSetting().load();
+        }
+
+        int poolWorkers() {
+            SharedPool &shared = sharedPool();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            return shared.pool ? shared.pool->workers() : 0;
+        }
+    } // Gemm
+} // Matrix
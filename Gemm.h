@@ -0,0 +1,62 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+namespace Matrix {
+    namespace Gemm {
+        // All routines compute C = A * B for n x n row-major operands whose
+        // rows are lda / ldb / ldc elements apart. C must not alias A or B.
+
+        // Sizes from this value up go through the packed, cache-blocked kernel.
+        constexpr int BlockedThreshold = 64;
+
+        // Sizes from this value up are split into ParallelTile x ParallelTile
+        // output tiles spread over the shared thread pool.
+        constexpr int ParallelThreshold = 256;
+        constexpr int ParallelTile = 240;
+
+        // Thread count multiply() uses when none is given; 0 selects one per
+        // hardware thread, which is also the default.
+        void setThreadCount(int threads);
+
+        int threadCount();
+
+        // Worker threads in the shared pool behind the parallel paths (0
+        // before the first parallel product). Requests for more threads are
+        // cut to the hardware thread count, so this stays below it.
+        int poolWorkers();
+
+        void multiply(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc);
+
+        // Same, on at most `threads` threads. Every output tile is computed by
+        // a single thread in a fixed order, so the result does not depend on
+        // the thread count.
+        void multiply(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc,
+                      int threads);
+
+        // How a multiply() operand's buffer is read: as stored, or as its
+        // transpose (element (i, j) at [j * ld + i]). Transposed operands are
+        // handled while packing, so they cost no extra pass over memory.
+        enum class Layout {
+            Normal,
+            Transposed
+        };
+
+        void multiply(int n, Layout layoutA, const double *a, int lda, Layout layoutB, const double *b, int ldb,
+                      double *c, int ldc, int threads);
+
+        // Straight i-j-k triple loop; kept as the reference for the fast paths.
+        void naive(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc);
+
+        // i-k-j loop that streams rows of B; same summation order as naive().
+        void simple(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc);
+
+        // Packed kernel; the register-blocked micro-kernel is chosen from
+        // Simd::active() on every call.
+        void blocked(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc);
+
+        void parallel(int n, const double *a, int lda, const double *b, int ldb, double *c, int ldc,
+                      int threads);
+    } // Gemm
+} // Matrix
+
+#endif //GEMM_H
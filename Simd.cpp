@@ -0,0 +1,55 @@
+#include "Simd.h"
+#include "Exceptions.h"
+#include <atomic>
+
+namespace Matrix {
+    namespace Simd {
+        namespace {
+            Isa detect() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx512f")) return Isa::AVX512;
+                if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return Isa::AVX2;
+                if (__builtin_cpu_supports("sse2")) return Isa::SSE2;
+#endif
+                return Isa::Scalar;
+            }
+
+            std::atomic<Isa> &current() {
+                static std::atomic<Isa> isa(detected());
+                return isa;
+            }
+        }
+
+        const char *name(Isa isa) {
+            switch (isa) {
+                case Isa::SSE2: return "sse2";
+                case Isa::AVX2: return "avx2";
+                case Isa::AVX512: return "avx512";
+                default: return "scalar";
+            }
+        }
+
+        Isa detected() {
+            static const Isa isa = detect();
+            return isa;
+        }
+
+        bool supported(Isa isa) {
+            return static_cast<int>(isa) <= static_cast<int>(detected());
+        }
+
+        Isa active() {
+            return current().load(std::memory_order_relaxed);
+        }
+
+        void force(Isa isa) {
+            if (!supported(isa)) throw InvalidOperation();
+            current().store(isa, std::memory_order_relaxed);
+        }
+
+        void reset() {
+            current().store(detected(), std::memory_order_relaxed);
+        }
+    } // Simd
+} // Matrix
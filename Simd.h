@@ -0,0 +1,35 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+namespace Matrix {
+    namespace Simd {
+        // Instruction sets the hand-vectorized kernels are written for, in
+        // increasing order of width.
+        enum class Isa {
+            Scalar,
+            SSE2,
+            AVX2,
+            AVX512
+        };
+
+        const char *name(Isa isa);
+
+        // Widest instruction set this CPU runs (detected once via CPUID).
+        Isa detected();
+
+        bool supported(Isa isa);
+
+        // Instruction set the kernels currently dispatch to: the detected one
+        // unless overridden with force().
+        Isa active();
+
+        // Pins dispatch to the given instruction set, e.g. to test a fallback
+        // path. Throws InvalidOperation if the CPU does not support it.
+        void force(Isa isa);
+
+        // Drops any force() override and returns to the detected instruction set.
+        void reset();
+    } // Simd
+} // Matrix
+
+#endif //SIMD_H
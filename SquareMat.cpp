@@ -3,69 +3,391 @@
 //
 
 #include "SquareMat.h"
+#include "Elementwise.h"
+#include "Gemm.h"
+#include "Transpose.h"
+#include <algorithm>
 #include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
 #include <iomanip>
+#include <memory>
+#include <new>
 #include <regex>
+#include <type_traits>
+#include <utility>
 
 namespace Matrix {
-    SquareMat::SquareMat(int size, double **data): size(size) {
+    namespace {
+        template<typename T>
+        struct IsComplex : std::false_type {
+        };
+
+        template<typename T>
+        struct IsComplex<std::complex<T> > : std::true_type {
+        };
+
+        // Owner of an adopted buffer, standing in for the allocator: freeing
+        // the storage runs the caller's deleter and then deletes the adapter.
+        template<typename T>
+        class AdoptedBuffer : public Allocator {
+        private:
+            std::function<void(T *)> deleter;
+
+        public:
+            explicit AdoptedBuffer(std::function<void(T *)> deleter): deleter(std::move(deleter)) {
+            }
+
+            void *allocate(std::size_t, std::size_t) override {
+                throw InvalidOperation();
+            }
+
+            void deallocate(void *p, std::size_t, std::size_t) noexcept override {
+                if (deleter) deleter(static_cast<T *>(p));
+                delete this;
+            }
+        };
+
+        // b = transpose(a) for n x n row-major buffers, the rows of a being
+        // lda elements apart; b is contiguous and must not alias a.
+        template<typename T>
+        void transposeInto(int n, const T *a, int lda, T *b) {
+            if constexpr (std::is_same<T, double>::value) {
+                Transpose::copy(n, a, lda, b, n);
+            } else {
+                for (int i0 = 0; i0 < n; i0 += Transpose::Tile)
+                    for (int j0 = 0; j0 < n; j0 += Transpose::Tile)
+                        for (int i = i0; i < std::min(n, i0 + Transpose::Tile); ++i)
+                            for (int j = j0; j < std::min(n, j0 + Transpose::Tile); ++j)
+                                b[static_cast<std::size_t>(j) * n + i] = a[static_cast<std::size_t>(i) * lda + j];
+            }
+        }
+
+        // c = op(a) * op(b) for n x n row-major operands whose rows are lda /
+        // ldb elements apart, where op transposes the operands flagged as
+        // Transposed; c is contiguous and must not alias a or b.
+        template<typename T>
+        void multiplyInto(int n, const T *a, int lda, Gemm::Layout layoutA, const T *b, int ldb,
+                          Gemm::Layout layoutB, T *c, int threads) {
+            if constexpr (std::is_same<T, double>::value) {
+                Gemm::multiply(n, layoutA, a, lda, layoutB, b, ldb, c, n, threads);
+            } else {
+                // Each step adds a scaled row of B to a row of c, which runs
+                // the SIMD addScaled for float; a transposed B is copied out
+                // first so those rows are contiguous (O(n^2) next to the
+                // O(n^3) product).
+                std::unique_ptr<T[]> copy;
+                if (layoutB == Gemm::Layout::Transposed) {
+                    copy.reset(new T[static_cast<std::size_t>(n) * n]);
+                    transposeInto(n, b, ldb, copy.get());
+                    b = copy.get();
+                    ldb = n;
+                }
+                const bool transA = layoutA == Gemm::Layout::Transposed;
+                const std::size_t strideA = lda, strideB = ldb;
+                std::fill(c, c + static_cast<std::size_t>(n) * n, T(0));
+                for (int i = 0; i < n; ++i) {
+                    T *row = c + static_cast<std::size_t>(i) * n;
+                    for (int k = 0; k < n; ++k) {
+                        const T aik = transA ? a[k * strideA + i] : a[i * strideA + k];
+                        Elementwise::addScaled(n, b + k * strideB, aik, row);
+                    }
+                }
+            }
+        }
+
+        template<typename T>
+        void multiplyInto(int n, const T *a, const T *b, T *c, int threads,
+                          Gemm::Layout layoutA = Gemm::Layout::Normal, Gemm::Layout layoutB = Gemm::Layout::Normal) {
+            multiplyInto(n, a, n, layoutA, b, n, layoutB, c, threads);
+        }
+
+        // result(i, j) = f(a(i, j)) over a view, into a contiguous n x n
+        // buffer.
+        template<typename T, typename F>
+        void mapView(const BasicSquareMatView<T> &a, T *result, F f) {
+            const int n = a.getSize();
+            for (int i = 0; i < n; ++i) {
+                const T *in = a.row(i);
+                T *out = result + static_cast<std::size_t>(i) * n;
+                for (int j = 0; j < n; ++j)
+                    out[j] = f(in[j]);
+            }
+        }
+
+        // result(i, j) = f(a(i, j), b(i, j)) for views of equal size.
+        template<typename T, typename F>
+        void zipViews(const BasicSquareMatView<T> &a, const BasicSquareMatView<T> &b, T *result, F f) {
+            const int n = a.getSize();
+            for (int i = 0; i < n; ++i) {
+                const T *x = a.row(i);
+                const T *y = b.row(i);
+                T *out = result + static_cast<std::size_t>(i) * n;
+                for (int j = 0; j < n; ++j)
+                    out[j] = f(x[j], y[j]);
+            }
+        }
+
+        // Runs a tolerance scan over a and b, in one go when both are
+        // contiguous and row by row otherwise, and locates the worst element.
+        template<typename T, typename Scan>
+        ApproxResult worstElement(const BasicSquareMatView<T> &a, const BasicSquareMatView<T> &b, Scan scan) {
+            const std::size_t n = static_cast<std::size_t>(a.getSize());
+            Elementwise::Deviation worst{n * n, 0.0, -HUGE_VAL};
+            if (a.getStride() == a.getSize() && b.getStride() == b.getSize()) {
+                worst = scan(n * n, a.raw(), b.raw());
+            } else {
+                for (int i = 0; i < a.getSize(); ++i) {
+                    const Elementwise::Deviation row = scan(n, a.row(i), b.row(i));
+                    if (row.excess > worst.excess) worst = {i * n + row.index, row.error, row.excess};
+                }
+            }
+            if (worst.index == n * n) return {true, -1, -1, 0.0};
+            return {false, static_cast<int>(worst.index / n), static_cast<int>(worst.index % n), worst.error};
+        }
+
+        template<typename T>
+        T viewSum(const BasicSquareMatView<T> &a) {
+            T total = T(0);
+            for (int i = 0; i < a.getSize(); ++i) {
+                const T *row = a.row(i);
+                for (int j = 0; j < a.getSize(); ++j)
+                    total += row[j];
+            }
+            return total;
+        }
+
+        // Equal matrices have equal sums, except that a sum can be NaN even
+        // for equal finite elements (inf - inf).
+        template<typename T>
+        bool sumsDiffer(const T &a, const T &b) {
+            return a == a && b == b && a != b;
+        }
+
+        // Element bits for hashing, with -0 folded into +0 so that elements
+        // that compare equal hash alike.
+        template<typename T>
+        std::uint64_t elementBits(const T &x) {
+            if constexpr (IsComplex<T>::value) {
+                return elementBits(x.real()) * 0x9E3779B97F4A7C15ull + elementBits(x.imag());
+            } else if constexpr (std::is_integral<T>::value) {
+                return static_cast<std::uint64_t>(x);
+            } else if constexpr (std::is_same<T, double>::value) {
+                std::uint64_t bits;
+                const double value = x + 0.0; // -0 + 0 is +0
+                std::memcpy(&bits, &value, sizeof bits);
+                return bits;
+            } else {
+                return std::hash<T>()(x);
+            }
+        }
+
+        // Each element is mixed on its own and folded into one of four lanes
+        // with a rotate and xor, so the per-element dependency chain stays
+        // two instructions long; the lanes, the size and the splitmix64
+        // finalizer make up the result.
+        template<typename T>
+        std::uint64_t hashElements(int size, const T *data) {
+            constexpr std::uint64_t Prime = 0x9E3779B97F4A7C15ull;
+            const std::size_t n = static_cast<std::size_t>(size) * size;
+            const auto step = [](std::uint64_t lane, const T &x) {
+                std::uint64_t h = elementBits(x) * Prime;
+                h ^= h >> 32;
+                return (lane << 23 | lane >> 41) ^ h;
+            };
+            std::uint64_t l0 = 1, l1 = 2, l2 = 3, l3 = 4;
+            std::size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                l0 = step(l0, data[i]);
+                l1 = step(l1, data[i + 1]);
+                l2 = step(l2, data[i + 2]);
+                l3 = step(l3, data[i + 3]);
+            }
+            for (; i < n; ++i)
+                l0 = step(l0, data[i]);
+            std::uint64_t h = static_cast<std::uint64_t>(size);
+            for (std::uint64_t lane : {l0, l1, l2, l3}) {
+                h = (h ^ lane) * Prime;
+                h ^= h >> 29;
+            }
+            h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+            h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+            return h ^ (h >> 31);
+        }
+
+        template<typename T>
+        void transposeSelf(int n, T *a) {
+            if constexpr (std::is_same<T, double>::value) {
+                Transpose::inPlace(n, a, n);
+            } else {
+                for (int i = 0; i < n; ++i)
+                    for (int j = i + 1; j < n; ++j)
+                        std::swap(a[static_cast<std::size_t>(i) * n + j], a[static_cast<std::size_t>(j) * n + i]);
+            }
+        }
+    }
+
+    template<typename T>
+    BasicSquareMat<T>::BasicSquareMat(int size, T **data): size(size) {
         if (size <= 0) {
             this->size = 0;
             throw InvalidOperation();
         }
-        allocate();
+        allocate(currentAllocator());
         for (int i = 0; i < size; i++) {
-            for (int j = 0; j < size; j++) {
-                this->data[i][j] = data[i][j];
-            }
+            std::copy(data[i], data[i] + size, this->data + static_cast<std::size_t>(i) * size);
         }
     }
 
-    SquareMat::SquareMat(int size): size(size) {
+    template<typename T>
+    BasicSquareMat<T>::BasicSquareMat(int size): BasicSquareMat(size, currentAllocator()) {
+    }
+
+    template<typename T>
+    BasicSquareMat<T>::BasicSquareMat(int size, Allocator &allocator): size(size) {
         if (size <= 0) {
             this->size = 0;
             throw InvalidOperation();
         }
-        allocate();
+        allocate(allocator);
     }
 
 
-    void SquareMat::allocate() {
-        data = new double *[size];
-        for (int i = 0; i < size; ++i) {
-            data[i] = new double[size]{};
+    template<typename T>
+    void BasicSquareMat<T>::allocate(Allocator &source) {
+        if (elements() <= static_cast<std::size_t>(InlineCapacity)) {
+            data = local;
+            allocator = nullptr;
+            std::fill(data, data + elements(), T(0));
+        } else {
+            data = static_cast<T *>(source.allocate(elements() * sizeof(T), Alignment));
+            allocator = &source;
+            std::uninitialized_fill(data, data + elements(), T(0));
         }
+        exposed = false;
     }
 
-    const void SquareMat::copyFrom(const SquareMat &other) {
+    template<typename T>
+    const void BasicSquareMat<T>::copyFrom(const BasicSquareMat &other) {
         size = other.size;
-        allocate();
+        allocate(currentAllocator());
+        std::copy(other.data, other.data + elements(), data);
+        copyCaches(other);
+    }
+
+    // Takes over the caches other holds for its current contents, which
+    // this matrix now has too, and drops the rest.
+    template<typename T>
+    void BasicSquareMat<T>::copyCaches(const BasicSquareMat &other) {
+        if (other.isCached(other.sumStamp)) {
+            cachedSum = other.cachedSum;
+            sumStamp.store(readyStamp(), std::memory_order_relaxed);
+        } else {
+            sumStamp.store(0, std::memory_order_relaxed);
+        }
+        if (other.isCached(other.hashStamp)) {
+            cachedHash = other.cachedHash;
+            hashStamp.store(readyStamp(), std::memory_order_relaxed);
+        } else {
+            hashStamp.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    template<typename T>
+    BasicSquareMat<T>::BasicSquareMat(int size, T *buffer, Deleter deleter): size(0), data(nullptr) {
+        try {
+            if (size <= 0 || !buffer) throw InvalidOperation();
+            allocator = new AdoptedBuffer<T>(std::move(deleter));
+        } catch (...) {
+            if (buffer && deleter) deleter(buffer);
+            throw;
+        }
+        this->size = size;
+        data = buffer;
+        exposed = true; // the caller may still write through `buffer`
+    }
+
+    template<typename T>
+    BasicSquareMat<T>::BasicSquareMat(int size, std::unique_ptr<T[]> buffer):
+        BasicSquareMat(size, buffer.release(), [](T *p) { delete[] p; }) {
+        exposed = false;
+    }
+
+    template<typename T>
+    typename BasicSquareMat<T>::Buffer BasicSquareMat<T>::release() {
+        if (!data) return Buffer();
+        Buffer buffer;
+        if (isInline()) {
+            buffer = Buffer(new T[elements()], [](T *p) { delete[] p; });
+            std::copy(data, data + elements(), buffer.get());
+        } else {
+            Allocator *owner = allocator;
+            const std::size_t bytes = elements() * sizeof(T);
+            buffer = Buffer(data, [owner, bytes](T *p) { owner->deallocate(p, bytes, Alignment); });
+        }
+        size = 0;
+        data = nullptr;
+        allocator = nullptr;
+        exposed = false;
+        touch();
+        return buffer;
+    }
+
+    template<typename T>
+    BasicSquareMat<T>::BasicSquareMat(const BasicSquareMatView<T> &view): BasicSquareMat(view.getSize()) {
         for (int i = 0; i < size; ++i) {
-            for (int j = 0; j < size; ++j) {
-                data[i][j] = other.data[i][j];
-            }
+            std::copy(view.row(i), view.row(i) + size, data + static_cast<std::size_t>(i) * size);
         }
     }
 
-    SquareMat::SquareMat(const SquareMat &other): size(other.size), data(nullptr) {
+    template<typename T>
+    BasicSquareMat<T>::BasicSquareMat(const BasicSquareMat &other): size(other.size), data(nullptr) {
         copyFrom(other);
     }
 
-    void SquareMat::deallocate() {
-        if (data) {
-            for (int i = 0; i < size; ++i) {
-                delete[] data[i];
-            }
-            delete[] data;
-            data = nullptr;
+    // A moved-from matrix is left empty (size 0, no storage); it may only be
+    // destroyed or assigned to.
+    template<typename T>
+    BasicSquareMat<T>::BasicSquareMat(BasicSquareMat &&other) noexcept: size(0), data(nullptr) {
+        takeStorage(other);
+    }
+
+    // Steals other's heap buffer, or copies its elements when they are local.
+    template<typename T>
+    void BasicSquareMat<T>::takeStorage(BasicSquareMat &other) noexcept {
+        size = other.size;
+        if (other.isInline()) {
+            data = local;
+            std::copy(other.local, other.local + elements(), local);
+            exposed = false;
+        } else {
+            data = other.data;
+            allocator = other.allocator;
+            exposed = other.exposed;
         }
+        copyCaches(other);
+        other.size = 0;
+        other.data = nullptr;
+        other.exposed = false;
+        other.touch();
     }
 
-    SquareMat::~SquareMat() {
+    template<typename T>
+    void BasicSquareMat<T>::deallocate() {
+        if (data && !isInline()) {
+            allocator->deallocate(data, elements() * sizeof(T), Alignment);
+        }
+        data = nullptr;
+    }
+
+    template<typename T>
+    BasicSquareMat<T>::~BasicSquareMat() {
         deallocate();
     }
 
-    SquareMat &SquareMat::operator=(const SquareMat &other) {
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator=(const BasicSquareMat &other) {
         if (this != &other) {
             deallocate();
             copyFrom(other);
@@ -73,244 +395,674 @@ namespace Matrix {
         return *this;
     }
 
-    const double *SquareMat::operator[](int i) const {
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator=(BasicSquareMat &&other) noexcept {
+        if (this != &other) {
+            deallocate();
+            takeStorage(other);
+        }
+        return *this;
+    }
+
+    template<typename T>
+    const T *BasicSquareMat<T>::operator[](int i) const {
         if (i < 0 || i >= size) throw InvalidOperation();
-        return data[i];
+        return data + static_cast<std::size_t>(i) * size;
     }
 
-    double *SquareMat::operator[](int i) {
+    template<typename T>
+    T *BasicSquareMat<T>::operator[](int i) {
         if (i < 0 || i >= size) throw InvalidOperation();
-        return data[i];
+        touch();
+        return data + static_cast<std::size_t>(i) * size;
     }
 
-    SquareMat SquareMat::operator+(const SquareMat &other) const {
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator+(const BasicSquareMat &other) const {
         if (size != other.size) throw SizeMismatch();
-        SquareMat result(size);
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j)
-                result[i][j] = data[i][j] + other[i][j];
+        BasicSquareMat result(size);
+        const std::size_t n = elements();
+        Elementwise::add(n, data, other.data, result.data);
         return result;
     }
 
-    SquareMat SquareMat::operator-(const SquareMat &other) const {
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator-(const BasicSquareMat &other) const {
         if (size != other.size) throw SizeMismatch();
-        SquareMat result(size);
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j)
-                result[i][j] = data[i][j] - other[i][j];
+        BasicSquareMat result(size);
+        const std::size_t n = elements();
+        Elementwise::subtract(n, data, other.data, result.data);
         return result;
     }
 
-    SquareMat SquareMat::operator-() const {
-        SquareMat result(size);
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j)
-                result[i][j] = -data[i][j];
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator-() const {
+        BasicSquareMat result(size);
+        const std::size_t n = elements();
+        Elementwise::negate(n, data, result.data);
         return result;
     }
 
-    SquareMat SquareMat::operator*(const SquareMat &other) const {
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator*(const BasicSquareMat &other) const {
         if (size != other.size) throw SizeMismatch();
-        SquareMat result(size);
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j)
-                for (int k = 0; k < size; ++k)
-                    result[i][j] += data[i][k] * other[k][j];
+        BasicSquareMat result(size);
+        multiplyInto(size, data, other.data, result.data, Gemm::threadCount());
         return result;
     }
 
-    SquareMat SquareMat::operator*(double scalar) const {
-        SquareMat result(size);
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j)
-                result[i][j] = data[i][j] * scalar;
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator*(const TransposedView<T> &other) const {
+        if (size != other.getSize()) throw SizeMismatch();
+        BasicSquareMat result(size);
+        multiplyInto(size, data, other.base().data, result.data, Gemm::threadCount(), Gemm::Layout::Normal,
+                     Gemm::Layout::Transposed);
         return result;
     }
 
-    SquareMat SquareMat::operator%(const SquareMat &other) const {
+    template<typename T>
+    BasicSquareMat<T> TransposedView<T>::operator*(const BasicSquareMat<T> &other) const {
+        if (getSize() != other.getSize()) throw SizeMismatch();
+        BasicSquareMat<T> result(getSize());
+        multiplyInto(getSize(), mat.raw(), other.raw(), result.data, Gemm::threadCount(),
+                     Gemm::Layout::Transposed, Gemm::Layout::Normal);
+        return result;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> TransposedView<T>::operator*(const TransposedView &other) const {
+        if (getSize() != other.getSize()) throw SizeMismatch();
+        BasicSquareMat<T> result(getSize());
+        multiplyInto(getSize(), mat.raw(), other.mat.raw(), result.data, Gemm::threadCount(),
+                     Gemm::Layout::Transposed, Gemm::Layout::Transposed);
+        return result;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::multiply(const BasicSquareMat &other, int threads) const {
         if (size != other.size) throw SizeMismatch();
-        SquareMat result(size);
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j)
-                result[i][j] = data[i][j] * other[i][j];
+        if (threads <= 0) throw InvalidOperation();
+        BasicSquareMat result(size);
+        multiplyInto(size, data, other.data, result.data, threads);
         return result;
     }
 
-    SquareMat SquareMat::operator%(int scalar) const {
-        if (scalar == 0) throw DivisionByZero();
-        SquareMat result(size);
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j)
-                result[i][j] = std::fmod(data[i][j], scalar);
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator*(T scalar) const {
+        BasicSquareMat result(size);
+        const std::size_t n = elements();
+        Elementwise::scale(n, data, scalar, result.data);
         return result;
     }
 
-    SquareMat SquareMat::operator/(double scalar) const {
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator%(const BasicSquareMat &other) const {
+        if (size != other.size) throw SizeMismatch();
+        BasicSquareMat result(size);
+        const std::size_t n = elements();
+        Elementwise::multiply(n, data, other.data, result.data);
+        return result;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator%(int scalar) const {
         if (scalar == 0) throw DivisionByZero();
-        SquareMat result(size);
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j)
-                result[i][j] = data[i][j] / scalar;
+        if constexpr (IsComplex<T>::value) {
+            throw InvalidOperation();
+        } else {
+            BasicSquareMat result(size);
+            Elementwise::remainder(elements(), data, scalar, result.data);
+            return result;
+        }
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator/(T scalar) const {
+        if (scalar == T(0)) throw DivisionByZero();
+        BasicSquareMat result(size);
+        const std::size_t n = elements();
+        Elementwise::divide(n, data, scalar, result.data);
         return result;
     }
 
-    SquareMat SquareMat::operator^(int exp) const {
+    // Binary exponentiation: O(log exp) products, ping-ponging between three
+    // buffers allocated up front.
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator^(int exp) const {
         if (exp < 0) throw InvalidOperation();
-        SquareMat res(size);
-        for (int i = 0; i < size; ++i) {
-            for (int j = 0; j < size; ++j) {
-                if (i == j) {
-                    res[i][j] = 1;
-                } else {
-                    res[i][j] = 0;
-                }
-            }
-        }
+        BasicSquareMat res(size);
         if (exp == 0) {
+            for (int i = 0; i < size; ++i) {
+                res.data[static_cast<std::size_t>(i) * size + i] = T(1);
+            }
             return res;
         }
-        SquareMat t(size, data);
-        for (int i = 0; i < exp; ++i) {
-            res *= t;
+        // The buffers are written directly and swapped around, so each
+        // target is touched first to drop caches it took over (base starts
+        // as a copy of *this, cached sum and hash included).
+        const int threads = Gemm::threadCount();
+        BasicSquareMat base(*this);
+        BasicSquareMat tmp(size);
+        bool identity = true;
+        while (exp > 0) {
+            if (exp & 1) {
+                if (identity) {
+                    std::copy(base.data, base.data + elements(), res.data);
+                    identity = false;
+                } else {
+                    tmp.touch();
+                    multiplyInto(size, res.data, base.data, tmp.data, threads);
+                    std::swap(res, tmp);
+                }
+            }
+            exp >>= 1;
+            if (exp > 0) {
+                tmp.touch();
+                multiplyInto(size, base.data, base.data, tmp.data, threads);
+                std::swap(base, tmp);
+            }
         }
         return res;
     }
 
-    SquareMat &SquareMat::operator+=(const SquareMat &other) { return *this = *this + other; }
-    SquareMat &SquareMat::operator-=(const SquareMat &other) { return *this = *this - other; }
-    SquareMat &SquareMat::operator*=(const SquareMat &other) { return *this = *this * other; }
-    SquareMat &SquareMat::operator*=(double scalar) { return *this = *this * scalar; }
-    SquareMat &SquareMat::operator%=(const SquareMat &other) { return *this = *this % other; }
-    SquareMat &SquareMat::operator%=(int scalar) { return *this = *this % scalar; }
-    SquareMat &SquareMat::operator/=(double scalar) { return *this = *this / scalar; }
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator+=(const BasicSquareMat &other) {
+        if (size != other.size) throw SizeMismatch();
+        touch();
+        const std::size_t n = elements();
+        Elementwise::add(n, data, other.data, data);
+        return *this;
+    }
 
-    SquareMat &SquareMat::operator++() {
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j)
-                ++data[i][j];
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator-=(const BasicSquareMat &other) {
+        if (size != other.size) throw SizeMismatch();
+        touch();
+        const std::size_t n = elements();
+        Elementwise::subtract(n, data, other.data, data);
         return *this;
     }
 
-    SquareMat SquareMat::operator++(int) {
-        SquareMat tmp(*this);
+    // Matrix product needs every input element after outputs are written, so
+    // this one still goes through a temporary.
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator*=(const BasicSquareMat &other) {
+        return *this = *this * other;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator*=(T scalar) {
+        touch();
+        const std::size_t n = elements();
+        Elementwise::scale(n, data, scalar, data);
+        return *this;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator%=(const BasicSquareMat &other) {
+        if (size != other.size) throw SizeMismatch();
+        touch();
+        const std::size_t n = elements();
+        Elementwise::multiply(n, data, other.data, data);
+        return *this;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator%=(int scalar) {
+        if (scalar == 0) throw DivisionByZero();
+        if constexpr (IsComplex<T>::value) {
+            throw InvalidOperation();
+        } else {
+            touch();
+            Elementwise::remainder(elements(), data, scalar, data);
+        }
+        return *this;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator/=(T scalar) {
+        if (scalar == T(0)) throw DivisionByZero();
+        touch();
+        const std::size_t n = elements();
+        Elementwise::divide(n, data, scalar, data);
+        return *this;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::addScaled(const BasicSquareMat &other, T alpha) {
+        if (size != other.size) throw SizeMismatch();
+        touch();
+        const std::size_t n = elements();
+        Elementwise::addScaled(n, other.data, alpha, data);
+        return *this;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator++() {
+        touch();
+        const std::size_t n = elements();
+        Elementwise::addScalar(n, data, T(1), data);
+        return *this;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator++(int) {
+        BasicSquareMat tmp(*this);
         ++(*this);
         return tmp;
     }
 
-    SquareMat &SquareMat::operator--() {
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j)
-                --data[i][j];
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::operator--() {
+        touch();
+        const std::size_t n = elements();
+        Elementwise::subtractScalar(n, data, T(1), data);
         return *this;
     }
 
-    SquareMat SquareMat::operator--(int) {
-        SquareMat tmp(*this);
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator--(int) {
+        BasicSquareMat tmp(*this);
         --(*this);
         return tmp;
     }
 
-    SquareMat SquareMat::operator~() const {
-        SquareMat result(size);
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j)
-                result[i][j] = data[j][i];
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMat<T>::operator~() const {
+        BasicSquareMat result(size);
+        transposeInto(size, data, size, result.data);
         return result;
     }
 
-    double SquareMat::operator!() const {
-        if (size == 1) return data[0][0];
-        if (size == 2) return D2Det();
-        return recDet();
+    template<typename T>
+    BasicSquareMat<T> &BasicSquareMat<T>::transposeInPlace() {
+        touch();
+        transposeSelf(size, data);
+        return *this;
     }
 
-    double SquareMat::D2Det() const {
-        return data[0][0] * data[1][1] - data[0][1] * data[1][0];
+    template<typename T>
+    TransposedView<T> BasicSquareMat<T>::transposed() const {
+        return TransposedView<T>(*this);
     }
 
-    double SquareMat::recDet() const {
-        double res = 0;
-        for (int i = 0; i < size; ++i) {
-            SquareMat minor = SquareMat::minor(0, i);
-            if (minor.size == 2) {
-                res += std::pow(-1, i) * data[0][i] * minor.D2Det();
-            } else {
-                res += std::pow(-1, i) * data[0][i] * minor.recDet();
+    template<typename T>
+    T BasicSquareMat<T>::operator!() const {
+        if (size == 1) return data[0];
+        if (size == 2) return D2Det();
+        if constexpr (std::is_integral<T>::value) {
+            return bareissDet();
+        } else {
+            BasicSquareMat lu(*this);
+            const int sign = lu.luDecompose();
+            T det = T(sign);
+            for (int i = 0; sign != 0 && i < size; ++i) {
+                det *= lu.data[static_cast<std::size_t>(i) * size + i];
             }
+            return det;
         }
-        return res;
     }
 
-    SquareMat SquareMat::minor(int col, int row) const {
-        SquareMat result(size - 1);
-        for (int i = 0; i < size; ++i) {
-            for (int j = 0; j < size; ++j) {
-                if (i != col && j != row) {
-                    if (i < col && j < row) {
-                        result[i][j] = data[i][j];
-                    } else if (i > col) {
-                        result[i - 1][j] = data[i][j];
-                    } else if (j > row) {
-                        result[i][j - 1] = data[i][j];
-                    } else {
-                        result[i - 1][j - 1] = data[i][j];
-                    }
+    template<typename T>
+    double BasicSquareMat<T>::logDeterminant(int &sign) const {
+        if constexpr (IsComplex<T>::value) {
+            sign = 0;
+            throw InvalidOperation();
+        } else if constexpr (std::is_integral<T>::value) {
+            BasicSquareMat<double> real(size);
+            std::copy(data, data + elements(), real.data);
+            return real.logDeterminant(sign);
+        } else {
+            BasicSquareMat lu(*this);
+            sign = lu.luDecompose();
+            if (sign == 0) return -HUGE_VAL;
+            double logDet = 0;
+            for (int i = 0; i < size; ++i) {
+                const T pivot = lu.data[static_cast<std::size_t>(i) * size + i];
+                if (pivot < 0) sign = -sign;
+                logDet += static_cast<double>(std::log(std::abs(pivot)));
+            }
+            return logDet;
+        }
+    }
+
+    template<typename T>
+    T BasicSquareMat<T>::D2Det() const {
+        return data[0] * data[3] - data[1] * data[2];
+    }
+
+    // In-place LU factorization with partial pivoting: afterwards the upper
+    // triangle holds U and the strict lower triangle the multipliers of L.
+    // Returns the sign of the row permutation, or 0 if the matrix is singular.
+    template<typename T>
+    int BasicSquareMat<T>::luDecompose() {
+        touch();
+        int sign = 1;
+        for (int k = 0; k < size; ++k) {
+            T *pivotRow = data + static_cast<std::size_t>(k) * size;
+            int pivot = k;
+            auto best = std::abs(pivotRow[k]);
+            for (int i = k + 1; i < size; ++i) {
+                const auto candidate = std::abs(data[static_cast<std::size_t>(i) * size + k]);
+                if (candidate > best) {
+                    best = candidate;
+                    pivot = i;
+                }
+            }
+            if (best == 0) return 0;
+            if (pivot != k) {
+                std::swap_ranges(pivotRow, pivotRow + size, data + static_cast<std::size_t>(pivot) * size);
+                sign = -sign;
+            }
+            for (int i = k + 1; i < size; ++i) {
+                T *row = data + static_cast<std::size_t>(i) * size;
+                const T factor = row[k] / pivotRow[k];
+                row[k] = factor;
+                for (int j = k + 1; j < size; ++j) {
+                    row[j] -= factor * pivotRow[j];
                 }
             }
         }
-        return result;
+        return sign;
     }
 
-    bool SquareMat::operator==(const SquareMat &other) const {
-        if (size != other.size) return false;
-        for (int i = 0; i < size; ++i) {
-            for (int j = 0; j < size; ++j) {
-                if (data[i][j] != other[i][j]) {
-                    return false;
+    // Fraction-free (Bareiss) elimination: every division is exact, so integer
+    // determinants come out exact as long as the intermediates fit in T.
+    template<typename T>
+    T BasicSquareMat<T>::bareissDet() const {
+        BasicSquareMat m(*this);
+        T sign = T(1);
+        T previous = T(1);
+        for (int k = 0; k < size - 1; ++k) {
+            if (m(k, k) == T(0)) {
+                int pivot = k + 1;
+                while (pivot < size && m(pivot, k) == T(0)) ++pivot;
+                if (pivot == size) return T(0);
+                std::swap_ranges(m.row(k), m.row(k) + size, m.row(pivot));
+                sign = -sign;
+            }
+            for (int i = k + 1; i < size; ++i) {
+                for (int j = k + 1; j < size; ++j) {
+                    m(i, j) = (m(i, j) * m(k, k) - m(i, k) * m(k, j)) / previous;
                 }
             }
+            previous = m(k, k);
         }
-        return true;
+        return sign * m(size - 1, size - 1);
+    }
+
+    // Const calls may race on the caches: only the caller that moves the
+    // stamp to "computing" stores the value, and the slot is never written
+    // again at this version once the stamp says ready, so readers that see
+    // it ready (here or in copyCaches) read a finished value.
+    template<typename T>
+    template<typename V, typename Compute>
+    V BasicSquareMat<T>::cached(V &slot, std::atomic<std::uint64_t> &stamp, Compute compute) const {
+        if (exposed) return compute();
+        const std::uint64_t ready = readyStamp();
+        std::uint64_t seen = stamp.load(std::memory_order_acquire);
+        if (seen == ready) return slot;
+        const V value = compute();
+        if (seen != ready + 1 && stamp.compare_exchange_strong(seen, ready + 1, std::memory_order_relaxed)) {
+            slot = value;
+            stamp.store(ready, std::memory_order_release);
+        }
+        return value;
+    }
+
+    template<typename T>
+    T BasicSquareMat<T>::sum() const {
+        return cached(cachedSum, sumStamp, [this] {
+            T total = T(0);
+            const std::size_t n = elements();
+            for (std::size_t i = 0; i < n; ++i)
+                total += data[i];
+            return total;
+        });
     }
 
-    bool SquareMat::operator!=(const SquareMat &other) const {
+    template<typename T>
+    std::size_t BasicSquareMat<T>::hash() const {
+        return cached(cachedHash, hashStamp, [this] {
+            return static_cast<std::size_t>(hashElements(size, data));
+        });
+    }
+
+    template<typename T>
+    bool BasicSquareMat<T>::operator==(const BasicSquareMat &other) const {
+        if (size != other.size) return false;
+        if (isCached(hashStamp) && other.isCached(other.hashStamp) && cachedHash != other.cachedHash) return false;
+        if (isCached(sumStamp) && other.isCached(other.sumStamp) && sumsDiffer(cachedSum, other.cachedSum))
+            return false;
+        return Elementwise::equal(elements(), data, other.data);
+    }
+
+    template<typename T>
+    bool BasicSquareMat<T>::operator!=(const BasicSquareMat &other) const {
         return !(*this == other);
     }
 
-    bool SquareMat::operator<(const SquareMat &other) const {
-        double sum1 = 0, sum2 = 0;
-        for (int i = 0; i < size; ++i)
-            for (int j = 0; j < size; ++j) {
-                sum1 += data[i][j];
-                sum2 += other[i][j];
-            }
-        return sum1 < sum2;
+    template<typename T>
+    bool BasicSquareMat<T>::operator<(const BasicSquareMat &other) const {
+        if (size != other.size) throw SizeMismatch();
+        if constexpr (IsComplex<T>::value) {
+            throw InvalidOperation();
+        } else {
+            return sum() < other.sum();
+        }
     }
 
-    bool SquareMat::operator<=(const SquareMat &other) const {
-        return *this < other || *this == other;
+    // The element comparison only runs when the sums tie.
+    template<typename T>
+    bool BasicSquareMat<T>::operator<=(const BasicSquareMat &other) const {
+        if (*this < other) return true;
+        return !sumsDiffer(sum(), other.sum()) && *this == other;
     }
 
-    bool SquareMat::operator>(const SquareMat &other) const {
+    template<typename T>
+    bool BasicSquareMat<T>::operator>(const BasicSquareMat &other) const {
         return !(*this <= other);
     }
 
-    bool SquareMat::operator>=(const SquareMat &other) const {
+    template<typename T>
+    bool BasicSquareMat<T>::operator>=(const BasicSquareMat &other) const {
         return !(*this < other);
     }
 
-    std::ostream &operator<<(std::ostream &out, const SquareMat &mat) {
-        for (int i = 0; i < mat.size; ++i) {
-            for (int j = 0; j < mat.size; ++j) {
-                out << mat[i][j];
-                if (j < mat.size - 1) out << " ";
+    template<typename T>
+    std::ostream &operator<<(std::ostream &out, const BasicSquareMat<T> &mat) {
+        for (int i = 0; i < mat.getSize(); ++i) {
+            for (int j = 0; j < mat.getSize(); ++j) {
+                out << mat(i, j);
+                if (j < mat.getSize() - 1) out << " ";
             }
             out << "\n";
         }
         return out;
     }
 
-    SquareMat operator*(double scalar, const SquareMat &mat){
-        return mat*scalar;
+    template<typename T>
+    BasicSquareMat<T> operator*(const typename BasicSquareMat<T>::value_type &scalar, const BasicSquareMat<T> &mat) {
+        return mat * scalar;
+    }
+
+    template<typename T>
+    BasicSquareMatView<T>::BasicSquareMatView(const T *data, int size, int stride): data(data), size(size),
+                                                                                   stride(stride) {
+        if (size <= 0 || stride < size) throw InvalidOperation();
+    }
+
+    template<typename T>
+    BasicSquareMatView<T> BasicSquareMatView<T>::slice(int row, int col, int size) const {
+        if (row < 0 || col < 0 || size <= 0 || row + size > this->size || col + size > this->size) {
+            throw InvalidOperation();
+        }
+        return BasicSquareMatView(data + static_cast<std::size_t>(row) * stride + col, size, stride);
     }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMatView<T>::add(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+        if (a.size != b.size) throw SizeMismatch();
+        BasicSquareMat<T> result(a.size);
+        zipViews(a, b, result.data, [](const T &x, const T &y) { return x + y; });
+        return result;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMatView<T>::subtract(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+        if (a.size != b.size) throw SizeMismatch();
+        BasicSquareMat<T> result(a.size);
+        zipViews(a, b, result.data, [](const T &x, const T &y) { return x - y; });
+        return result;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMatView<T>::hadamard(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+        if (a.size != b.size) throw SizeMismatch();
+        BasicSquareMat<T> result(a.size);
+        zipViews(a, b, result.data, [](const T &x, const T &y) { return x * y; });
+        return result;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMatView<T>::multiply(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+        if (a.size != b.size) throw SizeMismatch();
+        BasicSquareMat<T> result(a.size);
+        multiplyInto(a.size, a.data, a.stride, Gemm::Layout::Normal, b.data, b.stride, Gemm::Layout::Normal,
+                     result.data, Gemm::threadCount());
+        return result;
+    }
+
+    template<typename T>
+    bool BasicSquareMatView<T>::equal(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+        if (a.size != b.size) return false;
+        for (int i = 0; i < a.size; ++i) {
+            if (!Elementwise::equal(static_cast<std::size_t>(a.size), a.row(i), b.row(i))) return false;
+        }
+        return true;
+    }
+
+    template<typename T>
+    bool BasicSquareMatView<T>::less(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+        if (a.size != b.size) throw SizeMismatch();
+        if constexpr (IsComplex<T>::value) {
+            throw InvalidOperation();
+        } else {
+            return viewSum(a) < viewSum(b);
+        }
+    }
+
+    template<typename T>
+    ApproxResult BasicSquareMatView<T>::approx(const BasicSquareMatView &a, const BasicSquareMatView &b, double absTol,
+                                               double relTol) {
+        if (a.size != b.size) throw SizeMismatch();
+        if (!(absTol >= 0) || !(relTol >= 0)) throw InvalidOperation();
+        return worstElement(a, b, [absTol, relTol](std::size_t n, const T *x, const T *y) {
+            return Elementwise::worstOutside(n, x, y, absTol, relTol);
+        });
+    }
+
+    template<typename T>
+    ApproxResult BasicSquareMatView<T>::ulps(const BasicSquareMatView &a, const BasicSquareMatView &b,
+                                             std::uint64_t maxUlps) {
+        if (a.size != b.size) throw SizeMismatch();
+        if constexpr (IsComplex<T>::value || std::is_same<T, long double>::value) {
+            throw InvalidOperation();
+        } else {
+            return worstElement(a, b, [maxUlps](std::size_t n, const T *x, const T *y) {
+                return Elementwise::worstUlps(n, x, y, maxUlps);
+            });
+        }
+    }
+
+    template<typename T>
+    std::ostream &BasicSquareMatView<T>::print(std::ostream &out, const BasicSquareMatView &view) {
+        for (int i = 0; i < view.size; ++i) {
+            for (int j = 0; j < view.size; ++j) {
+                out << view(i, j);
+                if (j < view.size - 1) out << " ";
+            }
+            out << "\n";
+        }
+        return out;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMatView<T>::operator*(T scalar) const {
+        BasicSquareMat<T> result(size);
+        mapView(*this, result.data, [scalar](const T &x) { return x * scalar; });
+        return result;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMatView<T>::operator%(int scalar) const {
+        if (scalar == 0) throw DivisionByZero();
+        if constexpr (IsComplex<T>::value) {
+            throw InvalidOperation();
+        } else {
+            const int n = getSize();
+            BasicSquareMat<T> result(n);
+            for (int i = 0; i < n; ++i)
+                Elementwise::remainder(n, row(i), scalar, result.data + static_cast<std::size_t>(i) * n);
+            return result;
+        }
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMatView<T>::operator/(T scalar) const {
+        if (scalar == T(0)) throw DivisionByZero();
+        BasicSquareMat<T> result(size);
+        mapView(*this, result.data, [scalar](const T &x) { return x / scalar; });
+        return result;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMatView<T>::operator^(int exponent) const {
+        return BasicSquareMat<T>(*this) ^ exponent;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMatView<T>::operator-() const {
+        BasicSquareMat<T> result(size);
+        mapView(*this, result.data, [](const T &x) { return -x; });
+        return result;
+    }
+
+    template<typename T>
+    BasicSquareMat<T> BasicSquareMatView<T>::operator~() const {
+        BasicSquareMat<T> result(size);
+        transposeInto(size, data, stride, result.data);
+        return result;
+    }
+
+    // Both factor a copy anyway, so they reuse the matrix versions.
+    template<typename T>
+    T BasicSquareMatView<T>::operator!() const {
+        return !BasicSquareMat<T>(*this);
+    }
+
+    template<typename T>
+    double BasicSquareMatView<T>::logDeterminant(int &sign) const {
+        return BasicSquareMat<T>(*this).logDeterminant(sign);
+    }
+
+    std::ostream &operator<<(std::ostream &out, const ApproxResult &result) {
+        if (result.equal) return out << "equal within tolerance";
+        return out << "worst element (" << result.row << ", " << result.col << "), error " << result.error;
+    }
+
+#define SQUAREMAT_INSTANTIATE(T) \
+    template class BasicSquareMat<T>; \
+    template class TransposedView<T>; \
+    template class BasicSquareMatView<T>; \
+    template BasicSquareMat<T> operator*(const T &scalar, const BasicSquareMat<T> &mat); \
+    template std::ostream &operator<<(std::ostream &out, const BasicSquareMat<T> &mat);
+
+    SQUAREMAT_INSTANTIATE(float)
+    SQUAREMAT_INSTANTIATE(double)
+    SQUAREMAT_INSTANTIATE(long double)
+    SQUAREMAT_INSTANTIATE(std::int64_t)
+    SQUAREMAT_INSTANTIATE(std::complex<double>)
+
+#undef SQUAREMAT_INSTANTIATE
 } // Matrix
@@ -5,108 +5,545 @@
 #ifndef SQUAREMAT_H
 #define SQUAREMAT_H
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include "Allocator.h"
 #include "Exceptions.h"
 
+// Matrices with at most this many elements (4x4 by default) are stored inside
+// the object instead of on the heap.
+#ifndef SQUAREMAT_INLINE_CAPACITY
+#define SQUAREMAT_INLINE_CAPACITY 16
+#endif
+
 namespace Matrix {
-    class SquareMat {
+    namespace Expr {
+        template<typename E>
+        class Expression;
+    }
+
+    template<typename T>
+    class TransposedView;
+
+    template<typename T>
+    class BasicSquareMatView;
+
+    // Outcome of approxEqual and ulpEqual. When some element is out of
+    // tolerance, (row, col) is the worst one and error its |a - b| or ULP
+    // distance (NaN if either element is NaN); otherwise row and col are -1.
+    struct ApproxResult {
+        bool equal;
+        int row;
+        int col;
+        double error;
+
+        explicit operator bool() const {
+            return equal;
+        }
+    };
+
+    std::ostream &operator<<(std::ostream &out, const ApproxResult &result);
+
+    // Square matrix of T. Instantiated for float, double, long double,
+    // std::int64_t and std::complex<double>; SquareMat is the double version.
+    //  - operator%(int) is fmod for floating types and % for int64; complex
+    //    matrices throw InvalidOperation.
+    //  - operator! uses LU with partial pivoting, except int64, which uses
+    //    fraction-free (Bareiss) elimination to stay exact.
+    //  - Ordering operators and logDeterminant need an ordered T and throw
+    //    InvalidOperation for complex matrices.
+    //  - The blocked, SIMD and parallel matrix product is used for double;
+    //    the other types use a single-threaded, unblocked i-k-j loop, whose
+    //    row updates are SIMD for float only.
+    template<typename T>
+    class BasicSquareMat {
+    public:
+        using value_type = T;
+        using Deleter = std::function<void(T *)>;
+        using Buffer = std::unique_ptr<T[], Deleter>;
+
     private:
+        template<typename>
+        friend class BasicSquareMat;
+
+        template<typename>
+        friend class BasicSquareMatView;
+
+        template<typename>
+        friend class TransposedView;
+
+        // Storage is a single row-major buffer of size * size elements; row i
+        // starts at data + i * size. It is either local (small matrices), an
+        // allocation aligned to Alignment bytes, or a buffer adopted from the
+        // caller, whose alignment is whatever the caller gave.
+        static constexpr std::size_t Alignment = 64;
+        static constexpr int InlineCapacity = SQUAREMAT_INLINE_CAPACITY;
+
         int size;
-        double **data;
+        T *data;
+        Allocator *allocator = nullptr; // owner of data when it is not local
+        alignas(Alignment) T local[InlineCapacity > 0 ? InlineCapacity : 1];
+
+        // Element sum (for the ordering operators) and content hash, each
+        // computed on first use. Every write path bumps `version`, a plain
+        // counter that element loops can keep in a register, and a cache
+        // only counts while its stamp is readyStamp() of the current
+        // version. Once raw() or the non-const row() has handed out a
+        // pointer, `exposed` turns caching off until the matrix gets new
+        // storage, since writes through that pointer are never seen.
+        std::uint64_t version = 0;
+        bool exposed = false;
+        mutable std::atomic<std::uint64_t> sumStamp{0};
+        mutable std::atomic<std::uint64_t> hashStamp{0};
+        mutable T cachedSum = T(0);
+        mutable std::size_t cachedHash = 0;
+
+        void touch() {
+            ++version;
+        }
+
+        // Stamps of a cache filled (even) or being filled (odd) at the
+        // current version; 0 is never either.
+        std::uint64_t readyStamp() const {
+            return (version + 1) * 2;
+        }
+
+        bool isCached(const std::atomic<std::uint64_t> &stamp) const {
+            return !exposed && stamp.load(std::memory_order_acquire) == readyStamp();
+        }
 
-        void allocate();
+        template<typename V, typename Compute>
+        V cached(V &slot, std::atomic<std::uint64_t> &stamp, Compute compute) const;
+
+        void copyCaches(const BasicSquareMat &other);
+
+        std::size_t elements() const {
+            return static_cast<std::size_t>(size) * size;
+        }
+
+        void checkIndex(int row, int col) const {
+#ifdef SQUAREMAT_DEBUG
+            if (row < 0 || row >= size || col < 0 || col >= size) throw InvalidOperation();
+#else
+            (void) row;
+            (void) col;
+#endif
+        }
+
+        void allocate(Allocator &source);
 
         void deallocate();
 
-        const void copyFrom(const SquareMat &other);
+        void takeStorage(BasicSquareMat &other) noexcept;
+
+        const void copyFrom(const BasicSquareMat &other);
 
-        double D2Det() const;
+        T D2Det() const;
 
-        double recDet() const;
+        int luDecompose();
 
-        SquareMat minor(int col, int row) const;
+        T bareissDet() const;
+
+        T sum() const;
 
     public:
-        SquareMat(int size, double **data);
+        BasicSquareMat(int size, T **data);
+
+        BasicSquareMat(const BasicSquareMat &other);
+
+        BasicSquareMat(BasicSquareMat &&other) noexcept;
+
+        // Heap storage comes from currentAllocator() unless an allocator is
+        // given; copies and operator results use the current one too.
+        explicit BasicSquareMat(int size);
+
+        BasicSquareMat(int size, Allocator &allocator);
+
+        // Adopt a row-major buffer of size * size elements without copying;
+        // the matrix frees it with `deleter` (nothing, if empty) or delete[].
+        // Ownership passes even when these throw InvalidOperation (size <= 0
+        // or a null buffer): the buffer is freed before the exception leaves.
+        BasicSquareMat(int size, T *buffer, Deleter deleter);
 
-        SquareMat(const SquareMat &other);
+        BasicSquareMat(int size, std::unique_ptr<T[]> buffer);
 
-        explicit SquareMat(int size);
+        // Copies the viewed elements into a new, contiguous matrix.
+        explicit BasicSquareMat(const BasicSquareMatView<T> &view);
 
-        ~SquareMat();
+        // Evaluates a lazy elementwise expression in a single pass; see Expr.h.
+        template<typename E>
+        BasicSquareMat(const Expr::Expression<E> &expr);
+
+        ~BasicSquareMat();
 
         int getSize() const {
             return size;
         }
 
-        SquareMat &operator=(const SquareMat &other);
+        // True when the elements live inside the object rather than on the heap.
+        bool isInline() const {
+            return data == local;
+        }
 
-        SquareMat &operator=(SquareMat &other);
+        // Hands the size * size buffer to the caller, who frees it through the
+        // returned pointer, and leaves the matrix empty like a moved-from one.
+        // Heap and adopted buffers are handed out as they are; inline
+        // elements are copied into a new one.
+        Buffer release();
 
-        double *operator[](int row);
+        BasicSquareMat &operator=(const BasicSquareMat &other);
 
-        const double *operator[](int row) const;
+        BasicSquareMat &operator=(BasicSquareMat &&other) noexcept;
 
-        SquareMat operator+(const SquareMat &other) const;
+        template<typename E>
+        BasicSquareMat &operator=(const Expr::Expression<E> &expr);
 
-        SquareMat operator-(const SquareMat &other) const;
+        T *operator[](int row);
 
-        SquareMat operator*(const SquareMat &other) const;
+        const T *operator[](int row) const;
 
-        SquareMat operator*(double scalar) const;
+        // Unchecked access for hot loops. Indices are only validated when
+        // built with SQUAREMAT_DEBUG, in which case they throw like operator[].
+        // A reference from here or a row pointer from operator[] must not be
+        // kept and written through after a comparison or hash(), which may
+        // have cached the old contents; raw() and the non-const row() turn
+        // that caching off until the matrix gets new storage.
+        T &operator()(int row, int col) {
+            checkIndex(row, col);
+            touch();
+            return data[static_cast<std::size_t>(row) * size + col];
+        }
 
-        SquareMat operator%(const SquareMat &other) const;
+        const T &operator()(int row, int col) const {
+            checkIndex(row, col);
+            return data[static_cast<std::size_t>(row) * size + col];
+        }
 
-        SquareMat operator%(int scalar) const;
+        T *row(int i) {
+            checkIndex(i, 0);
+            exposed = true;
+            return data + static_cast<std::size_t>(i) * size;
+        }
 
-        SquareMat operator/(double scalar) const;
+        const T *row(int i) const {
+            checkIndex(i, 0);
+            return data + static_cast<std::size_t>(i) * size;
+        }
+
+        // The whole row-major buffer, size * size elements.
+        T *raw() {
+            exposed = true;
+            return data;
+        }
 
-        SquareMat operator^(int exponent) const;
+        const T *raw() const {
+            return data;
+        }
 
-        SquareMat operator-() const;
+        BasicSquareMat operator+(const BasicSquareMat &other) const;
 
-        SquareMat &operator+=(const SquareMat &other);
+        BasicSquareMat operator-(const BasicSquareMat &other) const;
 
-        SquareMat &operator-=(const SquareMat &other);
+        BasicSquareMat operator*(const BasicSquareMat &other) const;
 
-        SquareMat &operator*=(const SquareMat &other);
+        // Matrix product on at most `threads` threads; operator* uses
+        // Gemm::threadCount().
+        BasicSquareMat multiply(const BasicSquareMat &other, int threads) const;
 
-        SquareMat &operator*=(double scalar);
+        BasicSquareMat operator*(T scalar) const;
 
-        SquareMat &operator%=(const SquareMat &other);
+        BasicSquareMat operator%(const BasicSquareMat &other) const;
 
-        SquareMat &operator%=(int scalar);
+        BasicSquareMat operator%(int scalar) const;
 
-        SquareMat &operator/=(double scalar);
+        BasicSquareMat operator/(T scalar) const;
 
-        SquareMat &operator++(); // pre-increment
-        SquareMat operator++(int); // post-increment
-        SquareMat &operator--(); // pre-decrement
-        SquareMat operator--(int); // post-decrement
+        BasicSquareMat operator^(int exponent) const;
 
-        SquareMat operator~() const; // transpose
-        double operator!() const; // determinant
+        BasicSquareMat operator-() const;
 
-        bool operator==(const SquareMat &other) const;
+        BasicSquareMat &operator+=(const BasicSquareMat &other);
 
-        bool operator!=(const SquareMat &other) const;
+        BasicSquareMat &operator-=(const BasicSquareMat &other);
 
-        bool operator<(const SquareMat &other) const;
+        BasicSquareMat &operator*=(const BasicSquareMat &other);
 
-        bool operator<=(const SquareMat &other) const;
+        BasicSquareMat &operator*=(T scalar);
 
-        bool operator>(const SquareMat &other) const;
+        BasicSquareMat &operator%=(const BasicSquareMat &other);
 
-        bool operator>=(const SquareMat &other) const;
+        BasicSquareMat &operator%=(int scalar);
 
-        friend std::ostream &operator<<(std::ostream &out, const SquareMat &mat);
+        BasicSquareMat &operator/=(T scalar);
 
-        friend SquareMat operator*(double scalar, const SquareMat &mat);
+        // this += alpha * other, without building alpha * other.
+        BasicSquareMat &addScaled(const BasicSquareMat &other, T alpha);
+
+        BasicSquareMat &operator++(); // pre-increment
+        BasicSquareMat operator++(int); // post-increment
+        BasicSquareMat &operator--(); // pre-decrement
+        BasicSquareMat operator--(int); // post-decrement
+
+        BasicSquareMat operator~() const; // transpose
+
+        // Transposes this matrix without allocating.
+        BasicSquareMat &transposeInPlace();
+
+        // Non-owning view of the transpose; see TransposedView.
+        TransposedView<T> transposed() const;
+
+        // this * transpose(view.base()), without building the transpose.
+        BasicSquareMat operator*(const TransposedView<T> &other) const;
+
+        T operator!() const; // determinant
+
+        // log |determinant|, with the determinant's sign (-1, 0 or 1) stored
+        // in `sign`; stays finite where operator! would overflow.
+        double logDeterminant(int &sign) const;
+
+        // Hash of the size and elements, consistent with operator==; cached
+        // like the sum. Also available as std::hash<BasicSquareMat<T>>.
+        std::size_t hash() const;
+
+        // Elementwise ==. Sizes are checked first, then the hashes and sums
+        // when both sides already have them cached.
+        bool operator==(const BasicSquareMat &other) const;
+
+        bool operator!=(const BasicSquareMat &other) const;
+
+        bool operator<(const BasicSquareMat &other) const;
+
+        bool operator<=(const BasicSquareMat &other) const;
+
+        bool operator>(const BasicSquareMat &other) const;
+
+        bool operator>=(const BasicSquareMat &other) const;
+
+        // See BasicSquareMatView.
+        friend ApproxResult approxEqual(const BasicSquareMat &a, const BasicSquareMat &b, double absTol,
+                                        double relTol) {
+            return approxEqual(BasicSquareMatView<T>(a), BasicSquareMatView<T>(b), absTol, relTol);
+        }
+
+        friend ApproxResult ulpEqual(const BasicSquareMat &a, const BasicSquareMat &b, std::uint64_t maxUlps) {
+            return ulpEqual(BasicSquareMatView<T>(a), BasicSquareMatView<T>(b), maxUlps);
+        }
     };
 
-    SquareMat operator*(double scalar, const SquareMat &mat);
+    // Transpose of a matrix that is never materialized for products:
+    // A.transposed() * B, A * B.transposed() and A.transposed() *
+    // B.transposed() read the stored buffers transposed while packing. Any
+    // other use converts the view to a matrix, i.e. ~A. The view refers to
+    // the matrix and must not outlive it.
+    template<typename T>
+    class TransposedView {
+    private:
+        const BasicSquareMat<T> &mat;
+
+    public:
+        explicit TransposedView(const BasicSquareMat<T> &mat): mat(mat) {
+        }
+
+        const BasicSquareMat<T> &base() const {
+            return mat;
+        }
+
+        int getSize() const {
+            return mat.getSize();
+        }
 
-    std::ostream &operator<<(std::ostream &out, const SquareMat &mat);
+        const T &operator()(int row, int col) const {
+            return mat(col, row);
+        }
+
+        operator BasicSquareMat<T>() const {
+            return ~mat;
+        }
+
+        BasicSquareMat<T> operator*(const BasicSquareMat<T> &other) const;
+
+        BasicSquareMat<T> operator*(const TransposedView &other) const;
+    };
+
+    // Read-only square window onto row-major storage owned by someone else:
+    // an external buffer, a BasicSquareMat, or a slice of either. Row i starts
+    // at data + i * stride. The read-only operators take views on either side
+    // (matrices convert implicitly) and return new matrices; nothing is copied
+    // before that. The storage must outlive the view.
+    template<typename T>
+    class BasicSquareMatView {
+    private:
+        const T *data;
+        int size;
+        int stride;
+
+        void checkIndex(int row, int col) const {
+#ifdef SQUAREMAT_DEBUG
+            if (row < 0 || row >= size || col < 0 || col >= size) throw InvalidOperation();
+#else
+            (void) row;
+            (void) col;
+#endif
+        }
+
+        static BasicSquareMat<T> add(const BasicSquareMatView &a, const BasicSquareMatView &b);
+
+        static BasicSquareMat<T> subtract(const BasicSquareMatView &a, const BasicSquareMatView &b);
+
+        static BasicSquareMat<T> multiply(const BasicSquareMatView &a, const BasicSquareMatView &b);
+
+        static BasicSquareMat<T> hadamard(const BasicSquareMatView &a, const BasicSquareMatView &b);
+
+        static bool equal(const BasicSquareMatView &a, const BasicSquareMatView &b);
+
+        static bool less(const BasicSquareMatView &a, const BasicSquareMatView &b);
+
+        static ApproxResult approx(const BasicSquareMatView &a, const BasicSquareMatView &b, double absTol,
+                                   double relTol);
+
+        static ApproxResult ulps(const BasicSquareMatView &a, const BasicSquareMatView &b, std::uint64_t maxUlps);
+
+        static std::ostream &print(std::ostream &out, const BasicSquareMatView &view);
+
+    public:
+        // Throws InvalidOperation unless size > 0 and stride >= size.
+        BasicSquareMatView(const T *data, int size, int stride);
+
+        BasicSquareMatView(const T *data, int size): BasicSquareMatView(data, size, size) {
+        }
+
+        BasicSquareMatView(const BasicSquareMat<T> &mat): BasicSquareMatView(mat.raw(), mat.getSize()) {
+        }
+
+        int getSize() const {
+            return size;
+        }
+
+        int getStride() const {
+            return stride;
+        }
+
+        const T *raw() const {
+            return data;
+        }
+
+        const T &operator()(int row, int col) const {
+            checkIndex(row, col);
+            return data[static_cast<std::size_t>(row) * stride + col];
+        }
+
+        const T *row(int i) const {
+            checkIndex(i, 0);
+            return data + static_cast<std::size_t>(i) * stride;
+        }
+
+        // The size x size window whose top-left element is (row, col); throws
+        // InvalidOperation if it does not fit inside this view.
+        BasicSquareMatView slice(int row, int col, int size) const;
+
+        BasicSquareMat<T> operator*(T scalar) const;
+
+        BasicSquareMat<T> operator%(int scalar) const;
+
+        BasicSquareMat<T> operator/(T scalar) const;
+
+        BasicSquareMat<T> operator^(int exponent) const;
+
+        BasicSquareMat<T> operator-() const;
+
+        BasicSquareMat<T> operator~() const;
+
+        T operator!() const;
+
+        double logDeterminant(int &sign) const;
+
+        friend BasicSquareMat<T> operator+(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+            return add(a, b);
+        }
+
+        friend BasicSquareMat<T> operator-(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+            return subtract(a, b);
+        }
+
+        friend BasicSquareMat<T> operator*(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+            return multiply(a, b);
+        }
+
+        friend BasicSquareMat<T> operator*(T scalar, const BasicSquareMatView &view) {
+            return view * scalar;
+        }
+
+        friend BasicSquareMat<T> operator%(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+            return hadamard(a, b);
+        }
+
+        friend bool operator==(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+            return equal(a, b);
+        }
+
+        friend bool operator!=(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+            return !equal(a, b);
+        }
+
+        friend bool operator<(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+            return less(a, b);
+        }
+
+        friend bool operator<=(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+            return less(a, b) || equal(a, b);
+        }
+
+        friend bool operator>(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+            return !(a <= b);
+        }
+
+        friend bool operator>=(const BasicSquareMatView &a, const BasicSquareMatView &b) {
+            return !less(a, b);
+        }
+
+        // Tolerant comparison for checking optimized kernels against a
+        // reference: each element needs a == b or a finite |a - b| <=
+        // max(absTol, relTol * max(|a|, |b|)). The result names the element
+        // furthest past its allowance. Throws SizeMismatch for different sizes and
+        // InvalidOperation for negative or NaN tolerances.
+        friend ApproxResult approxEqual(const BasicSquareMatView &a, const BasicSquareMatView &b, double absTol,
+                                        double relTol) {
+            return approx(a, b, absTol, relTol);
+        }
+
+        // Each element may be at most maxUlps representable values away
+        // (exact difference for integers); -0 and +0 count as equal. Throws
+        // InvalidOperation for long double and complex matrices.
+        friend ApproxResult ulpEqual(const BasicSquareMatView &a, const BasicSquareMatView &b, std::uint64_t maxUlps) {
+            return ulps(a, b, maxUlps);
+        }
+
+        friend std::ostream &operator<<(std::ostream &out, const BasicSquareMatView &view) {
+            return print(out, view);
+        }
+    };
+
+    template<typename T>
+    BasicSquareMat<T> operator*(const typename BasicSquareMat<T>::value_type &scalar, const BasicSquareMat<T> &mat);
+
+    template<typename T>
+    std::ostream &operator<<(std::ostream &out, const BasicSquareMat<T> &mat);
+
+    using SquareMat = BasicSquareMat<double>;
+    using SquareMatView = BasicSquareMatView<double>;
 } // Matrix
 
+namespace std {
+    template<typename T>
+    struct hash<Matrix::BasicSquareMat<T> > {
+        std::size_t operator()(const Matrix::BasicSquareMat<T> &mat) const {
+            return mat.hash();
+        }
+    };
+} // std
+
 #endif //SQUAREMAT_H
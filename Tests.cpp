@@ -1,7 +1,22 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "Tests.h"
 #include "SquareMat.h"
+#include "Expr.h"
+#include "FixedSquareMat.h"
+#include "Gemm.h"
+#include "Simd.h"
+#include "Transpose.h"
+#include "Elementwise.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
 #include <sstream>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 using namespace Matrix;
 
 // Helpers
@@ -26,6 +41,16 @@ void delete_matrix(double** arr, int n) {
     delete[] arr;
 }
 
+// Fills a matrix with deterministic pseudo-random values in [-1, 1).
+void fill_random(SquareMat& m, unsigned seed) {
+    unsigned state = seed;
+    for (int i = 0; i < m.getSize(); ++i)
+        for (int j = 0; j < m.getSize(); ++j) {
+            state = state * 1664525u + 1013904223u;
+            m[i][j] = static_cast<double>(state >> 8) / (1u << 23) - 1.0;
+        }
+}
+
 // ================= TEST CASES ===================
 
 TEST_CASE("Addition") {
@@ -247,3 +272,948 @@ TEST_CASE("Compound matrix multiplication operator *=") {
     CHECK(A == E);
     delete_matrix(a, n); delete_matrix(b, n); delete_matrix(e, n);
 }
+
+TEST_CASE("Contiguous aligned storage") {
+    int n = 3;
+    auto a = make_matrix(n, {{1.0, 2.0, 3.0}, {4.0, 5.0, 6.0}, {7.0, 8.0, 9.0}});
+    SquareMat A(n, a);
+    CHECK(reinterpret_cast<std::uintptr_t>(A[0]) % 64 == 0);
+    CHECK(A[1] == A[0] + n);
+    CHECK(A[2] == A[0] + 2 * n);
+    CHECK(A[0][5] == 6.0);
+    SquareMat B(A);
+    CHECK(B[0] != A[0]);
+    CHECK(B == A);
+    delete_matrix(a, n);
+}
+
+TEST_CASE("Move construction and assignment") {
+    int n = 8;
+    SquareMat A(n);
+    fill_random(A, 8);
+    SquareMat E(A);
+    const double *buffer = A[0];
+    SquareMat B(std::move(A));
+    CHECK(B[0] == buffer);
+    CHECK(B == E);
+    CHECK(A.getSize() == 0);
+    SquareMat C(1);
+    C = std::move(B);
+    CHECK(C[0] == buffer);
+    CHECK(C == E);
+    CHECK(B.getSize() == 0);
+    B = C;
+    CHECK(B == E);
+}
+
+TEST_CASE("In-place compound operators keep storage") {
+    int n = 2;
+    auto a = make_matrix(n, {{1.0, 2.0}, {3.0, 4.0}});
+    auto b = make_matrix(n, {{4.0, 3.0}, {2.0, 1.0}});
+    auto e = make_matrix(n, {{9.0, 8.0}, {7.0, 6.0}});
+    SquareMat A(n, a), B(n, b), E(n, e);
+    const double *buffer = A[0];
+    A.addScaled(B, 2.0);
+    CHECK(A == E);
+    A -= B;
+    A += B;
+    A *= 2.0;
+    A /= 2.0;
+    A %= B;
+    A %= 5;
+    CHECK(A[0] == buffer);
+    CHECK_THROWS_AS(A.addScaled(SquareMat(3), 1.0), SizeMismatch);
+    CHECK_THROWS_AS(A += SquareMat(3), SizeMismatch);
+    delete_matrix(a, n); delete_matrix(b, n); delete_matrix(e, n);
+}
+
+TEST_CASE("Blocked multiplication matches reference") {
+    for (int n : {5, 64, 67, 150}) {
+        SquareMat A(n), B(n), C(n), R(n);
+        fill_random(A, 1);
+        fill_random(B, 2);
+        Gemm::naive(n, A[0], n, B[0], n, R[0], n);
+        Gemm::blocked(n, A[0], n, B[0], n, C[0], n);
+        SquareMat P = A * B;
+        CHECK(approxEqual(C, R, 1e-12, 1e-12));
+        CHECK(approxEqual(P, R, 1e-12, 1e-12));
+    }
+}
+
+TEST_CASE("SIMD multiplication kernels match reference") {
+    const int n = 131;
+    SquareMat A(n), B(n), R(n);
+    fill_random(A, 3);
+    fill_random(B, 4);
+    Gemm::naive(n, A[0], n, B[0], n, R[0], n);
+    for (Simd::Isa isa : {Simd::Isa::Scalar, Simd::Isa::SSE2, Simd::Isa::AVX2, Simd::Isa::AVX512}) {
+        if (!Simd::supported(isa)) {
+            CHECK_THROWS_AS(Simd::force(isa), InvalidOperation);
+            continue;
+        }
+        Simd::force(isa);
+        CHECK(Simd::active() == isa);
+        SquareMat P = A * B;
+        CHECK(approxEqual(P, R, 1e-12, 1e-12));
+    }
+    Simd::reset();
+    CHECK(Simd::active() == Simd::detected());
+}
+
+TEST_CASE("Parallel multiplication is deterministic") {
+    const int n = 300;
+    SquareMat A(n), B(n), R(n);
+    fill_random(A, 5);
+    fill_random(B, 6);
+    Gemm::blocked(n, A[0], n, B[0], n, R[0], n);
+    for (int threads : {1, 2, 3, 4}) {
+        CHECK(A.multiply(B, threads) == R);
+    }
+    const int saved = Gemm::threadCount();
+    Gemm::setThreadCount(3);
+    CHECK(Gemm::threadCount() == 3);
+    CHECK((A * B) == R);
+    Gemm::setThreadCount(saved);
+    CHECK_THROWS_AS(A.multiply(B, 0), InvalidOperation);
+    CHECK_THROWS_AS(Gemm::setThreadCount(-1), InvalidOperation);
+}
+
+TEST_CASE("Concurrent products while the shared pool grows") {
+    const int n = 300;
+    SquareMat A(n), B(n), R(n);
+    fill_random(A, 5);
+    fill_random(B, 6);
+    Gemm::blocked(n, A[0], n, B[0], n, R[0], n);
+    std::atomic<bool> stop(false);
+    std::atomic<int> wrong(0);
+    std::thread background([&] {
+        while (!stop) {
+            if (A.multiply(B, 2) != R) ++wrong;
+        }
+    });
+    for (int threads = 3; threads < 24; ++threads) {
+        if (A.multiply(B, threads) != R) ++wrong;
+    }
+    stop = true;
+    background.join();
+    CHECK(wrong == 0);
+}
+
+TEST_CASE("Oversized thread requests do not grow the shared pool") {
+    const int n = 500;
+    SquareMat A(n), B(n), R(n);
+    fill_random(A, 5);
+    fill_random(B, 6);
+    Gemm::blocked(n, A[0], n, B[0], n, R[0], n);
+    CHECK(A.multiply(B, 10000) == R);
+    const int hardware = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    CHECK(Gemm::poolWorkers() < hardware);
+    CHECK(Gemm::poolWorkers() < 9); // one thread per 240 x 240 tile of 500 x 500
+}
+
+TEST_CASE("LU determinant") {
+    int n = 4;
+    auto a = make_matrix(n, {{2.0, -1.0, 0.0, 3.0}, {1.0, 4.0, -2.0, 0.0}, {0.0, 5.0, 1.0, -1.0}, {3.0, 0.0, 2.0, 1.0}});
+    SquareMat A(n, a);
+    CHECK(doctest::Approx(!A) == -103.0);
+    int sign = 0;
+    CHECK(doctest::Approx(A.logDeterminant(sign)) == std::log(103.0));
+    CHECK(sign == -1);
+    for (int j = 0; j < n; ++j)
+        A[3][j] = 2.0 * A[0][j];
+    CHECK(!A == 0.0);
+    CHECK(A.logDeterminant(sign) == -HUGE_VAL);
+    CHECK(sign == 0);
+    delete_matrix(a, n);
+
+    SquareMat D(400);
+    for (int i = 0; i < 400; ++i)
+        D[i][i] = i % 2 ? -10.0 : 10.0;
+    CHECK(std::isinf(!D));
+    CHECK(D.logDeterminant(sign) == doctest::Approx(400 * std::log(10.0)));
+    CHECK(sign == 1);
+}
+
+TEST_CASE("Power by squaring") {
+    int n = 3;
+    auto a = make_matrix(n, {{1.0, 1.0, 0.0}, {0.0, 1.0, 1.0}, {0.0, 0.0, 1.0}});
+    auto e = make_matrix(n, {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}});
+    SquareMat A(n, a), I(n, e);
+    CHECK((A ^ 0) == I);
+    CHECK((A ^ 1) == A);
+    SquareMat P = A ^ 1000;
+    CHECK(P[0][1] == 1000.0);
+    CHECK(P[0][2] == 499500.0);
+    SquareMat Q(I);
+    for (int i = 0; i < 13; ++i)
+        Q *= A;
+    CHECK((A ^ 13) == Q);
+    CHECK_THROWS_AS(A ^ -1, InvalidOperation);
+    delete_matrix(a, n); delete_matrix(e, n);
+}
+
+TEST_CASE("Unchecked element access") {
+    int n = 2;
+    auto a = make_matrix(n, {{1.0, 2.0}, {3.0, 4.0}});
+    SquareMat A(n, a);
+    const SquareMat &C = A;
+    A(0, 1) = 7.0;
+    CHECK(C(0, 1) == 7.0);
+    CHECK(A.row(1) == A[1]);
+    CHECK(C.raw()[3] == 4.0);
+#ifdef SQUAREMAT_DEBUG
+    CHECK_THROWS_AS(A(2, 0), InvalidOperation);
+    CHECK_THROWS_AS(C(0, -1), InvalidOperation);
+    CHECK_THROWS_AS(A.row(2), InvalidOperation);
+#endif
+    delete_matrix(a, n);
+}
+
+TEST_CASE("Lazy elementwise expressions") {
+    int n = 2;
+    auto a = make_matrix(n, {{1.0, 2.0}, {3.0, 4.0}});
+    auto b = make_matrix(n, {{4.0, 3.0}, {2.0, 1.0}});
+    SquareMat A(n, a), B(n, b);
+    SquareMat E = A + B - (-A) * 2.0 % B / 4.0;
+    SquareMat R = lazy(A) + B - -lazy(A) * 2.0 % B / 4.0;
+    CHECK(R == E);
+    SquareMat H = 3.0 * (lazy(A) % lazy(B));
+    CHECK(H == (A % B) * 3.0);
+    const double *buffer = R[0];
+    R = lazy(R) + R;
+    CHECK(R[0] == buffer);
+    CHECK(R == E * 2.0);
+    SquareMat W(3);
+    W = lazy(A) - B;
+    CHECK(W == A - B);
+    CHECK_THROWS_AS(SquareMat(lazy(A) + SquareMat(3)), SizeMismatch);
+    CHECK_THROWS_AS(SquareMat(lazy(A) / 0.0), DivisionByZero);
+    delete_matrix(a, n); delete_matrix(b, n);
+}
+
+TEST_CASE("Fixed-size matrices") {
+    constexpr FixedSquareMat<2> A{1.0, 2.0, 3.0, 4.0};
+    constexpr FixedSquareMat<2> B{4.0, 3.0, 2.0, 1.0};
+    static_assert((A * A)(1, 1) == 22.0, "product");
+    static_assert((A ^ 2) == A * A, "power");
+    static_assert((!A) == -2.0, "2x2 determinant");
+    static_assert((~A)(0, 1) == 3.0, "transpose");
+    static_assert((A + B) == FixedSquareMat<2>{5.0, 5.0, 5.0, 5.0}, "sum");
+    static_assert(-A < B && A <= B + A && B + B > A, "ordering");
+    constexpr FixedSquareMat<4> D{2.0, -1.0, 0.0, 3.0, 1.0, 4.0, -2.0, 0.0, 0.0, 5.0, 1.0, -1.0, 3.0, 0.0, 2.0, 1.0};
+    static_assert((!D) == -103.0, "4x4 determinant");
+    static_assert((!FixedSquareMat<1>{7.0}) == 7.0, "1x1 determinant");
+
+    FixedSquareMat<5> F = FixedSquareMat<5>::identity() * 2.0;
+    F(0, 4) = 3.0;
+    CHECK(!F == doctest::Approx(32.0));
+
+    FixedSquareMat<2> C = A;
+    C %= 3;
+    CHECK(C == FixedSquareMat<2>{1.0, 2.0, 0.0, 1.0});
+    CHECK_THROWS_AS(C /= 0.0, DivisionByZero);
+    CHECK_THROWS_AS(C[2], InvalidOperation);
+    CHECK_THROWS_AS((FixedSquareMat<2>{1.0, 2.0}), SizeMismatch);
+
+    SquareMat S = static_cast<SquareMat>(A);
+    CHECK(S[1][0] == 3.0);
+    CHECK(FixedSquareMat<2>(S * S) == A * A);
+    CHECK_THROWS_AS((FixedSquareMat<3>(S)), SizeMismatch);
+}
+
+TEST_CASE("Small matrices use inline storage") {
+    int n = 4;
+    SquareMat A(n), Big(n + 1);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j)
+            A[i][j] = i + j - 3;
+    CHECK(A.isInline());
+    CHECK_FALSE(Big.isInline());
+    const char *object = reinterpret_cast<const char *>(&A);
+    const char *elements = reinterpret_cast<const char *>(A.raw());
+    CHECK(elements >= object);
+    CHECK(elements < object + sizeof(SquareMat));
+    CHECK(reinterpret_cast<std::uintptr_t>(A.raw()) % 64 == 0);
+
+    SquareMat copy(A);
+    SquareMat moved(std::move(copy));
+    CHECK(moved.isInline());
+    CHECK(moved == A);
+    CHECK(copy.getSize() == 0);
+    Big = std::move(moved);
+    CHECK(Big.isInline());
+    CHECK(Big == A);
+    SquareMat P = A ^ 5;
+    CHECK(P == A * A * A * A * A);
+}
+
+TEST_CASE("Element types other than double") {
+    BasicSquareMat<float> F(2);
+    F(0, 0) = 1.5f; F(0, 1) = 2.0f; F(1, 0) = -3.0f; F(1, 1) = 4.0f;
+    CHECK((F * F)(1, 0) == -16.5f);
+    CHECK((F % 2)(0, 0) == 1.5f);
+    CHECK(!F == 12.0f);
+    CHECK((2.0f * F)(1, 1) == 8.0f);
+
+    BasicSquareMat<long double> L(3);
+    for (int i = 0; i < 3; ++i)
+        L(i, i) = 2.0L;
+    CHECK(!L == 8.0L);
+
+    BasicSquareMat<std::int64_t> I(4);
+    const std::int64_t values[4][4] = {{0, -1, 0, 3}, {1, 4, -2, 0}, {0, 5, 1, -1}, {3, 0, 2, 1}};
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            I(i, j) = values[i][j];
+    CHECK(!I == -147);
+    I(0, 0) = -7;
+    CHECK((I % 3)(0, 0) == -1);
+    CHECK((I % -1)(0, 0) == 0);
+    CHECK(I < I * 2);
+    int sign = 0;
+    CHECK(I.logDeterminant(sign) == doctest::Approx(std::log(std::abs(static_cast<double>(!I)))));
+
+    using Complex = std::complex<double>;
+    BasicSquareMat<Complex> C(2);
+    C(0, 0) = Complex(0, 1); C(0, 1) = Complex(1, 0);
+    C(1, 0) = Complex(1, 0); C(1, 1) = Complex(0, 1);
+    CHECK(!C == Complex(-2, 0));
+    CHECK((C ^ 2)(0, 1) == Complex(0, 2));
+    CHECK((++C)(0, 0) == Complex(1, 1));
+    CHECK_THROWS_AS(C % 2, InvalidOperation);
+    CHECK_THROWS_AS((void) (C < C), InvalidOperation);
+    CHECK_THROWS_AS(C.logDeterminant(sign), InvalidOperation);
+}
+
+
+TEST_CASE("Pluggable allocators") {
+    SquareMat A(8), B(8);
+    fill_random(A, 3);
+    fill_random(B, 4);
+    const SquareMat expected = A * B + A;
+
+    Arena arena(4096);
+    {
+        ScopedAllocator scope(arena);
+        SquareMat C = A * B + A;
+        CHECK(C == expected);
+        CHECK(arena.used() >= 2 * 8 * 8 * sizeof(double));
+        SquareMat small(2);
+        CHECK(small.isInline());
+        SquareMat big(40);
+        CHECK(arena.used() >= 40 * 40 * sizeof(double));
+        big(39, 39) = 1.0;
+        CHECK(!big == 0.0);
+    }
+    const std::size_t used = arena.used();
+    SquareMat D = A * B;
+    CHECK(arena.used() == used);
+
+    arena.reset();
+    CHECK(arena.used() == 0);
+    {
+        SquareMat E(8, arena);
+        CHECK(arena.used() == 8 * 8 * sizeof(double));
+        E = A;
+        CHECK(E == A);
+        SquareMat F(std::move(E));
+        CHECK(F == A);
+    }
+    CHECK(&currentAllocator() == &BufferPool::instance());
+}
+
+
+TEST_CASE("Freed buffers are recycled by size") {
+    BufferPool &pool = BufferPool::instance();
+    pool.release();
+    SquareMat A(16), B(16);
+    fill_random(A, 5);
+    fill_random(B, 6);
+    SquareMat C = A + B - A; // warm-up: the first pass fills the free list
+    C = A + B - A;
+    pool.resetStats();
+    for (int i = 0; i < 10; ++i) {
+        C = A + B - A;
+    }
+    CHECK(C == A + B - A);
+    CHECK(pool.stats().misses == 0);
+    CHECK(pool.stats().hits >= 20);
+    CHECK(pool.stats().bytesRetained > 0);
+
+    pool.release();
+    CHECK(pool.stats().bytesRetained == 0);
+    const std::size_t limit = pool.retentionLimit();
+    pool.setRetentionLimit(0);
+    { SquareMat D(A); }
+    CHECK(pool.stats().bytesRetained == 0);
+    pool.setRetentionLimit(limit);
+    { SquareMat D(A); }
+    CHECK(pool.stats().bytesRetained == 16 * 16 * sizeof(double));
+}
+
+
+TEST_CASE("Blocked and in-place transpose") {
+    for (Simd::Isa isa : {Simd::Isa::Scalar, Simd::Isa::SSE2, Simd::Isa::AVX2, Simd::Isa::AVX512}) {
+        if (!Simd::supported(isa)) continue;
+        Simd::force(isa);
+        for (int n : {1, 3, 8, 9, 31, 33, 64, 100, 130}) {
+            CAPTURE(Simd::name(isa));
+            CAPTURE(n);
+            SquareMat A(n);
+            fill_random(A, n);
+            SquareMat expected(n);
+            for (int i = 0; i < n; ++i)
+                for (int j = 0; j < n; ++j)
+                    expected(j, i) = A(i, j);
+            CHECK(~A == expected);
+            SquareMat B(A);
+            CHECK(B.transposeInPlace() == expected);
+            CHECK(B.transposeInPlace() == A);
+        }
+    }
+    Simd::reset();
+
+    // Strided operands: transpose the top-left 20 x 20 corner of a 24-wide buffer.
+    std::vector<double> a(24 * 24), b(24 * 24, -1.0);
+    for (std::size_t i = 0; i < a.size(); ++i)
+        a[i] = static_cast<double>(i);
+    Transpose::copy(20, a.data(), 24, b.data(), 24);
+    CHECK(b[3 * 24 + 5] == a[5 * 24 + 3]);
+    CHECK(b[20] == -1.0);
+    Transpose::inPlace(20, a.data(), 24);
+    CHECK(a[3 * 24 + 5] == 5 * 24 + 3);
+    CHECK(a[22] == 22);
+
+    BasicSquareMat<std::int64_t> I(5);
+    I(1, 3) = 7;
+    CHECK((~I)(3, 1) == 7);
+    CHECK(I.transposeInPlace()(3, 1) == 7);
+}
+
+
+TEST_CASE("Products with transposed views") {
+    const int saved = Gemm::threadCount();
+    Gemm::setThreadCount(3);
+    for (int n : {5, 64, 100, 300}) {
+        CAPTURE(n);
+        SquareMat A(n), B(n);
+        fill_random(A, 7 * n);
+        fill_random(B, 11 * n);
+        const SquareMat At = ~A, Bt = ~B;
+        CHECK(A.transposed() * B == At * B);
+        CHECK(A * B.transposed() == A * Bt);
+        CHECK(A.transposed() * B.transposed() == At * Bt);
+    }
+    Gemm::setThreadCount(saved);
+
+    SquareMat A(3);
+    A(0, 2) = 4.0;
+    SquareMat T = A.transposed();
+    CHECK(T(2, 0) == 4.0);
+    CHECK(A.transposed()(2, 0) == 4.0);
+    CHECK((A + A.transposed())(2, 0) == 4.0);
+    CHECK_THROWS_AS(A * SquareMat(4).transposed(), SizeMismatch);
+
+    BasicSquareMat<std::int64_t> I(2);
+    I(0, 0) = 1; I(0, 1) = 2; I(1, 0) = 3; I(1, 1) = 4;
+    CHECK(I.transposed() * I == ~I * I);
+    CHECK(I * I.transposed() == I * ~I);
+
+    // Float rows go through the SIMD addScaled, which rounds the same way as
+    // the scalar loop; sizes leave remainders for every vector width.
+    for (int n : {5, 19, 37}) {
+        CAPTURE(n);
+        BasicSquareMat<float> F(n), G(n), expected(n);
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j) {
+                F(i, j) = static_cast<float>((i * 7 + j * 3) % 11) - 5.25f;
+                G(i, j) = static_cast<float>((i * 5 + j * 13) % 17) * 0.125f;
+            }
+        for (int i = 0; i < n; ++i)
+            for (int k = 0; k < n; ++k)
+                for (int j = 0; j < n; ++j)
+                    expected(i, j) += F(i, k) * G(j, k);
+        CHECK(F * G.transposed() == expected);
+        CHECK(F * ~G == expected);
+    }
+}
+
+
+TEST_CASE("Views over external buffers and slices") {
+    // A 6 x 6 square inside rows of 8 doubles.
+    std::vector<double> buffer(8 * 6);
+    for (int i = 0; i < 6; ++i)
+        for (int j = 0; j < 8; ++j)
+            buffer[i * 8 + j] = j < 6 ? i * 6 + j + (i == j ? 40.0 : 0.0) : -1000.0;
+    SquareMatView V(buffer.data(), 6, 8);
+    SquareMat M(V);
+    CHECK(M.getSize() == 6);
+    CHECK(M(2, 3) == 15.0);
+    CHECK(V(5, 5) == 75.0);
+
+    // Every read-only operator agrees with the owning copy.
+    SquareMat B(6);
+    fill_random(B, 21);
+    CHECK(V + B == M + B);
+    CHECK(B - V == B - M);
+    CHECK(V * B == M * B);
+    CHECK(B * V == B * M);
+    CHECK(V % B == M % B);
+    CHECK(V * 2.0 == M * 2.0);
+    CHECK(2.0 * V == 2.0 * M);
+    CHECK(V / 4.0 == M / 4.0);
+    CHECK(V % 7 == M % 7);
+    CHECK((V ^ 3) == (M ^ 3));
+    CHECK(-V == -M);
+    CHECK(~V == ~M);
+    CHECK(!V == doctest::Approx(!M));
+    int signV = 0, signM = 0;
+    CHECK(V.logDeterminant(signV) == doctest::Approx(M.logDeterminant(signM)));
+    CHECK(signV == signM);
+    CHECK(V == M);
+    CHECK_FALSE(V != M);
+    CHECK(B < V);
+    CHECK(V >= B);
+    std::ostringstream a, b;
+    a << V;
+    b << M;
+    CHECK(a.str() == b.str());
+
+    // Slices share the parent's storage and stride.
+    SquareMatView S = V.slice(1, 2, 3);
+    CHECK(S.getStride() == 8);
+    CHECK(S(0, 0) == V(1, 2));
+    CHECK(S(2, 2) == V(3, 4));
+    buffer[3 * 8 + 4] = 0.5;
+    CHECK(S(2, 2) == 0.5);
+    SquareMat T(S);
+    CHECK(S * T == T * T);
+    CHECK(SquareMatView(M).slice(4, 4, 2) == SquareMatView(M).slice(4, 4, 2));
+    CHECK_THROWS_AS(V.slice(4, 4, 3), InvalidOperation);
+    CHECK_THROWS_AS(SquareMatView(buffer.data(), 6, 5), InvalidOperation);
+    CHECK_THROWS_AS(V + S, SizeMismatch);
+
+    // Strided operands through the blocked product.
+    SquareMat L(100);
+    fill_random(L, 8);
+    const SquareMatView inner = SquareMatView(L).slice(10, 20, 70);
+    const SquareMat copy(inner);
+    CHECK(inner * inner == copy * copy);
+    CHECK(~inner == ~copy);
+}
+
+
+TEST_CASE("Adopting and releasing buffers") {
+    std::unique_ptr<double[]> owned(new double[36]);
+    for (int i = 0; i < 36; ++i)
+        owned[i] = i;
+    const double *address = owned.get();
+    SquareMat A(6, std::move(owned));
+    CHECK(A.raw() == address);
+    CHECK(A(2, 3) == 15.0);
+    CHECK_FALSE(A.isInline());
+
+    // Moves keep the adopted buffer; release() hands it back out.
+    SquareMat B(std::move(A));
+    CHECK(B.raw() == address);
+    SquareMat::Buffer released = B.release();
+    CHECK(released.get() == address);
+    CHECK(B.getSize() == 0);
+    CHECK(released[35] == 35.0);
+
+    int freed = 0;
+    double external[9] = {2, 0, 0, 0, 3, 0, 0, 0, 4};
+    {
+        SquareMat C(3, external, [&freed](double *) { ++freed; });
+        CHECK(!C == 24.0);
+        C(0, 0) = 1.0;
+    }
+    CHECK(freed == 1);
+    CHECK(external[0] == 1.0);
+    CHECK_THROWS_AS(SquareMat(0, external, [&freed](double *) { ++freed; }), InvalidOperation);
+    CHECK(freed == 2);
+
+    // Pool-backed and inline storage can be released too.
+    SquareMat D(8);
+    D(7, 7) = 5.0;
+    SquareMat::Buffer heap = D.release();
+    CHECK(heap[63] == 5.0);
+    SquareMat E(2);
+    E(1, 1) = 6.0;
+    CHECK(E.release()[3] == 6.0);
+}
+
+
+TEST_CASE("SIMD elementwise kernels match the scalar loops") {
+    for (Simd::Isa isa : {Simd::Isa::Scalar, Simd::Isa::AVX2, Simd::Isa::AVX512}) {
+        if (!Simd::supported(isa)) continue;
+        Simd::force(isa);
+        for (int n : {1, 3, 5, 9}) {
+            CAPTURE(Simd::name(isa));
+            CAPTURE(n);
+            SquareMat A(n), B(n);
+            fill_random(A, 31 * n);
+            fill_random(B, 37 * n);
+            A(0, 0) = 0.0;
+            const std::size_t count = static_cast<std::size_t>(n) * n;
+            std::vector<double> expected(count);
+            auto same = [&](const SquareMat &m) {
+                return std::equal(expected.begin(), expected.end(), m.raw(), [](double x, double y) {
+                    return std::memcmp(&x, &y, sizeof x) == 0;
+                });
+            };
+            for (std::size_t i = 0; i < count; ++i) expected[i] = A.raw()[i] + B.raw()[i];
+            CHECK(same(A + B));
+            for (std::size_t i = 0; i < count; ++i) expected[i] = A.raw()[i] - B.raw()[i];
+            CHECK(same(A - B));
+            for (std::size_t i = 0; i < count; ++i) expected[i] = -A.raw()[i];
+            CHECK(same(-A));
+            CHECK(std::signbit((-A)(0, 0)));
+            for (std::size_t i = 0; i < count; ++i) expected[i] = A.raw()[i] * B.raw()[i];
+            CHECK(same(A % B));
+            for (std::size_t i = 0; i < count; ++i) expected[i] = A.raw()[i] * 1.7;
+            CHECK(same(A * 1.7));
+            for (std::size_t i = 0; i < count; ++i) expected[i] = A.raw()[i] / 1.7;
+            CHECK(same(A / 1.7));
+            SquareMat C(A);
+            for (std::size_t i = 0; i < count; ++i) expected[i] = A.raw()[i] + 1.0;
+            CHECK(same(++C));
+            for (std::size_t i = 0; i < count; ++i) expected[i] = A.raw()[i] + 1.0 - 1.0;
+            CHECK(same(--C));
+            for (std::size_t i = 0; i < count; ++i) expected[i] = C.raw()[i] + 0.3 * B.raw()[i];
+            CHECK(same(C.addScaled(B, 0.3)));
+        }
+    }
+    Simd::reset();
+
+    // The generic loops serve other element types.
+    float x[3] = {1, 2, 3}, y[3] = {4, 5, 6};
+    Elementwise::add(3, x, y, x);
+    CHECK(x[2] == 9.0f);
+}
+
+
+TEST_CASE("Vectorized remainder matches std::fmod bit for bit") {
+    const double big = 4503599627370496.0; // 2^52
+    const std::vector<double> values = {
+        0.0, -0.0, 1.0, -1.0, 6.0, -6.0, 7.5, -7.5, 1e-310, -1e-310, 0.1, 2.9999999999999996,
+        3.0000000000000004, 1e15 + 0.5, -1e15 - 0.5, big, -big, big * 4 + 8, 1e300,
+        std::nextafter(3.0 * 1000003, 0.0), std::nextafter(-9.0, 0.0), HUGE_VAL, -HUGE_VAL, std::nan(""),
+        123456789.125, -987654321.75, 5e-324, 1.5, 2.5, 3.5};
+    for (Simd::Isa isa : {Simd::Isa::Scalar, Simd::Isa::AVX2, Simd::Isa::AVX512}) {
+        if (!Simd::supported(isa)) continue;
+        Simd::force(isa);
+        for (int divisor : {1, -1, 2, 3, -3, 7, 1000003, 2147483647, -2147483647 - 1}) {
+            CAPTURE(Simd::name(isa));
+            CAPTURE(divisor);
+            std::vector<double> out(values.size());
+            Elementwise::remainder(values.size(), values.data(), divisor, out.data());
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                CAPTURE(values[i]);
+                const double expected = std::fmod(values[i], static_cast<double>(divisor));
+                CHECK((std::isnan(expected) ? std::isnan(out[i]) : std::memcmp(&expected, &out[i], sizeof(double)) == 0));
+            }
+        }
+    }
+    Simd::reset();
+
+    const std::vector<std::int64_t> integers = {0, 1, -1, 41, -41, 1000000007, -999999999999LL,
+                                                INT64_MAX, INT64_MIN, INT64_MIN + 1};
+    for (int divisor : {1, -1, 2, -5, 97, 2147483647, -2147483647 - 1}) {
+        CAPTURE(divisor);
+        std::vector<std::int64_t> out(integers.size());
+        Elementwise::remainder(integers.size(), integers.data(), divisor, out.data());
+        for (std::size_t i = 0; i < integers.size(); ++i)
+            CHECK(out[i] == (divisor == -1 ? 0 : integers[i] % divisor));
+    }
+}
+
+
+TEST_CASE("Ordering uses a cached sum that follows every mutation") {
+    SquareMat A(8), B(8);
+    fill_random(A, 1);
+    fill_random(B, 2);
+    A(0, 0) = 1000;
+    CHECK(B < A);
+    CHECK_FALSE(A <= B);
+
+    A(0, 0) = -1000;
+    CHECK(A < B);
+    A += B;
+    A += B;
+    A.raw()[5] += 5000;
+    CHECK(B < A);
+    A[5][5] -= 10000;
+    CHECK(A < B);
+    A.row(5)[5] += 10000;
+    CHECK(B < A);
+    A *= -1.0;
+    CHECK(A < B);
+    A = B;
+    CHECK(A <= B);
+    CHECK(A >= B);
+    ++A;
+    CHECK(B < A);
+    A -= B % B;
+    A.addScaled(B % B, 1.0);
+    CHECK(B < A);
+
+    SquareMat C(B);
+    CHECK(C >= B);
+    C(7, 7) -= 1;
+    CHECK(C < B);
+    SquareMat D(std::move(C));
+    CHECK(D < B);
+    C = B;
+    C[0][0] = B(0, 0) + 0.5;
+    CHECK(B < C);
+    CHECK(B <= C);
+    CHECK_FALSE(C <= B);
+
+    std::vector<SquareMat> mats;
+    for (int i = 0; i < 20; ++i) {
+        mats.emplace_back(5);
+        fill_random(mats.back(), 100 + i);
+    }
+    std::sort(mats.begin(), mats.end());
+    CHECK(std::is_sorted(mats.begin(), mats.end()));
+    for (std::size_t i = 1; i < mats.size(); ++i) {
+        double before = 0, after = 0;
+        for (int k = 0; k < 25; ++k) {
+            before += mats[i - 1].raw()[k];
+            after += mats[i].raw()[k];
+        }
+        CHECK(before <= after);
+    }
+
+    // A pointer from raw() may be kept and written through between
+    // comparisons; the matrix stops caching until it gets new storage.
+    SquareMat E(4), F(4);
+    double *p = E.raw();
+    CHECK_FALSE(F < E);
+    const std::size_t before = E.hash();
+    p[3] = 1;
+    CHECK(F < E);
+    CHECK(E.hash() != before);
+    p[3] = -1;
+    CHECK(E < F);
+    SquareMat G(E);
+    CHECK(G < F);
+    G(0, 0) = 2;
+    CHECK(F < G);
+
+    // Powers start from a copy of the base, whose cached sum must not
+    // reach the result.
+    for (int n : {2, 3, 5, 9}) {
+        CAPTURE(n);
+        SquareMat P(n), Z(n), big(n);
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j)
+                P(i, j) = 2;
+        big(0, 0) = 100;
+        CHECK(Z < P);
+        CHECK_FALSE((P ^ 3) < big);
+        CHECK((P ^ 3) > big);
+        CHECK_FALSE((P * P * P) < big);
+    }
+
+    // Concurrent const calls on one matrix, including copies of it, agree
+    // with a fresh computation.
+    SquareMat H(40);
+    fill_random(H, 5);
+    const SquareMat reference(H);
+    const std::size_t expected = reference.hash();
+    std::atomic<int> wrong{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&H, &reference, expected, &wrong] {
+            for (int k = 0; k < 200; ++k) {
+                const SquareMat copy(H);
+                if (copy.hash() != expected || H.hash() != expected || !(copy <= reference)) ++wrong;
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    CHECK(wrong == 0);
+}
+
+
+TEST_CASE("Equality fast paths agree with elementwise comparison") {
+    for (Simd::Isa isa : {Simd::Isa::Scalar, Simd::Isa::AVX2, Simd::Isa::AVX512}) {
+        if (!Simd::supported(isa)) continue;
+        Simd::force(isa);
+        CAPTURE(Simd::name(isa));
+        for (int n : {1, 3, 4, 5, 17}) {
+            CAPTURE(n);
+            SquareMat A(n);
+            fill_random(A, 7);
+            SquareMat B(A);
+            CHECK(A == B);
+            for (int k = 0; k < n * n; ++k) {
+                const double saved = B.raw()[k];
+                B.raw()[k] = saved + 1;
+                CHECK(A != B);
+                B.raw()[k] = std::nan("");
+                CHECK(A != B);
+                B.raw()[k] = saved;
+            }
+            CHECK(A == B);
+            A.raw()[n * n - 1] = 0.0;
+            B.raw()[n * n - 1] = -0.0;
+            CHECK(A == B);
+            CHECK(A.hash() == B.hash());
+            CHECK(SquareMatView(A) == SquareMatView(B));
+            A(0, 0) = std::nan("");
+            CHECK_FALSE(A == A);
+        }
+    }
+    Simd::reset();
+
+    // Cached hashes and sums reject without reading elements, and are
+    // dropped by writes.
+    SquareMat A(6), B(6);
+    fill_random(A, 1);
+    B = A;
+    CHECK(A.hash() == B.hash());
+    CHECK(A == B);
+    B(2, 3) += 1;
+    CHECK(A.hash() != B.hash());
+    CHECK(A != B);
+    CHECK_FALSE((A <= B && B <= A));
+    B(2, 3) -= 1;
+    CHECK(A == B);
+
+    // inf + -inf: equal matrices whose sums are NaN.
+    SquareMat infinite(2);
+    infinite(0, 0) = HUGE_VAL;
+    infinite(0, 1) = -HUGE_VAL;
+    SquareMat same(infinite);
+    CHECK_FALSE(infinite < same);
+    CHECK(infinite <= same);
+    CHECK(infinite == same);
+
+    BasicSquareMat<std::int64_t> I(5), J(5);
+    I(4, 4) = 9;
+    CHECK(I != J);
+    J(4, 4) = 9;
+    CHECK(I == J);
+    CHECK(std::hash<BasicSquareMat<std::int64_t> >()(I) == std::hash<BasicSquareMat<std::int64_t> >()(J));
+
+    std::unordered_set<SquareMat> unique;
+    for (int i = 0; i < 40; ++i) {
+        SquareMat m(8);
+        fill_random(m, 500 + i % 10);
+        unique.insert(m);
+    }
+    CHECK(unique.size() == 10);
+    SquareMat probe(8);
+    fill_random(probe, 503);
+    CHECK(unique.count(probe) == 1);
+    probe(0, 0) += 1e-9;
+    CHECK(unique.count(probe) == 0);
+
+    // A power must not inherit its base's cached hash. Small integers keep
+    // both association orders exact.
+    SquareMat M(3);
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            M(i, j) = (i * 3 + j) % 4 - 1;
+    const std::size_t baseHash = M.hash();
+    const SquareMat cube = M * M * M;
+    CHECK((M ^ 3) == cube);
+    CHECK((M ^ 3).hash() == cube.hash());
+    CHECK((M ^ 3).hash() != baseHash);
+    CHECK(std::unordered_set<SquareMat>{cube}.count(M ^ 3) == 1);
+}
+
+
+TEST_CASE("Approximate equality reports the worst element") {
+    for (Simd::Isa isa : {Simd::Isa::Scalar, Simd::Isa::AVX2, Simd::Isa::AVX512}) {
+        if (!Simd::supported(isa)) continue;
+        Simd::force(isa);
+        CAPTURE(Simd::name(isa));
+        for (int n : {1, 3, 4, 5, 17}) {
+            CAPTURE(n);
+            SquareMat A(n);
+            fill_random(A, 3 * n);
+            SquareMat B(A);
+            CHECK(approxEqual(A, B, 0, 0));
+            CHECK(ulpEqual(A, B, 0));
+
+            const int last = n - 1;
+            B(last, last) = std::nextafter(A(last, last), 2.0);
+            CHECK_FALSE(ulpEqual(A, B, 0));
+            CHECK(ulpEqual(A, B, 1));
+            const ApproxResult off = ulpEqual(A, B, 0);
+            CHECK(off.row == last);
+            CHECK(off.col == last);
+            CHECK(off.error == 1.0);
+            CHECK(approxEqual(A, B, 0, 1e-15));
+
+            B(0, 0) = A(0, 0) + 0.25;
+            B(last, 0) = A(last, 0) + 0.5;
+            const ApproxResult worst = approxEqual(A, B, 0.1, 0);
+            CHECK_FALSE(worst);
+            CHECK(worst.row == last);
+            CHECK(worst.col == 0);
+            CHECK(worst.error == doctest::Approx(0.5));
+            CHECK(approxEqual(A, B, 0.5, 0));
+
+            B(0, last) = std::nan("");
+            const ApproxResult nan = approxEqual(A, B, 1.0, 1.0);
+            CHECK(nan.row == 0);
+            CHECK(nan.col == last);
+            CHECK(std::isnan(nan.error));
+            CHECK(ulpEqual(A, B, 1000).col == last);
+        }
+    }
+    Simd::reset();
+
+    // -0 and +0, equal infinities and values straddling zero.
+    SquareMat X(2), Y(2);
+    X(0, 0) = -0.0;
+    X(0, 1) = HUGE_VAL;
+    Y(0, 1) = HUGE_VAL;
+    X(1, 0) = 5e-324;
+    Y(1, 0) = -5e-324;
+    CHECK(ulpEqual(X, Y, 2));
+    CHECK_FALSE(ulpEqual(X, Y, 1));
+    CHECK(approxEqual(X, Y, 1e-300, 0));
+    Y(0, 1) = -HUGE_VAL;
+    CHECK(approxEqual(X, Y, 1e300, 1e300).col == 1);
+
+    // Slices are compared row by row.
+    SquareMat big(6);
+    fill_random(big, 9);
+    SquareMatView window = SquareMatView(big).slice(1, 2, 3);
+    SquareMat copy(window);
+    CHECK(approxEqual(window, copy, 0, 0));
+    copy(2, 1) += 1e-3;
+    const ApproxResult sliced = approxEqual(copy, window, 1e-6, 0);
+    CHECK(sliced.row == 2);
+    CHECK(sliced.col == 1);
+
+    BasicSquareMat<std::int64_t> I(3), J(3);
+    J(1, 2) = 4;
+    CHECK(ulpEqual(I, J, 4));
+    CHECK(ulpEqual(I, J, 3).col == 2);
+    CHECK(approxEqual(I, J, 3.5, 0).row == 1);
+    BasicSquareMat<float> F(2), G(2);
+    G(1, 1) = std::nextafter(0.0f, 1.0f);
+    CHECK(ulpEqual(F, G, 1));
+    CHECK_THROWS_AS(ulpEqual(BasicSquareMat<std::complex<double> >(2), BasicSquareMat<std::complex<double> >(2), 1),
+                    InvalidOperation);
+    CHECK(approxEqual(BasicSquareMat<std::complex<double> >(2), BasicSquareMat<std::complex<double> >(2), 0, 0));
+    CHECK_THROWS_AS(approxEqual(X, SquareMat(3), 1, 1), SizeMismatch);
+    CHECK_THROWS_AS(approxEqual(X, Y, -1, 0), InvalidOperation);
+    CHECK_THROWS_AS(approxEqual(X, Y, 0, std::nan("")), InvalidOperation);
+
+    // At scale: the blocked, threaded product against the reference loop.
+    const int n = 257;
+    SquareMat A(n), B(n), R(n);
+    fill_random(A, 41);
+    fill_random(B, 43);
+    Gemm::naive(n, A.raw(), n, B.raw(), n, R.raw(), n);
+    CHECK(approxEqual(A.multiply(B, 4), R, 1e-12, 1e-12));
+}
@@ -0,0 +1,79 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace Matrix {
+    ThreadPool::ThreadPool(int workers) {
+        for (int i = 0; i < workers; ++i) {
+            threads.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Claims indices of the current job until none are left.
+    void ThreadPool::drain() {
+        int finishedHere = 0;
+        for (int i = job.next.fetch_add(1); i < job.count; i = job.next.fetch_add(1)) {
+            (*job.task)(i);
+            ++finishedHere;
+        }
+        if (finishedHere > 0 && job.done.fetch_add(finishedHere) + finishedHere == job.count) {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.notify_all();
+        }
+    }
+
+    void ThreadPool::workerLoop() {
+        unsigned long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+                if (job.joined >= job.helpers) continue;
+                ++job.joined;
+                ++active;
+            }
+            drain();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active == 0) finished.notify_all();
+        }
+    }
+
+    void ThreadPool::parallelFor(int count, int threads, const std::function<void(int)> &task) {
+        std::unique_lock<std::mutex> running(runMutex, std::try_to_lock);
+        const int helpers = std::min(threads - 1, workers());
+        if (!running.owns_lock() || helpers <= 0 || count <= 1) {
+            for (int i = 0; i < count; ++i) {
+                task(i);
+            }
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // A worker that woke late for the previous job may still be leaving it.
+            finished.wait(lock, [&] { return active == 0; });
+            job.task = &task;
+            job.count = count;
+            job.helpers = helpers;
+            job.joined = 0;
+            job.next.store(0);
+            job.done.store(0);
+            ++generation;
+        }
+        wake.notify_all();
+        drain();
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return job.done.load() == job.count && active == 0; });
+    }
+} // Matrix
@@ -0,0 +1,62 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Matrix {
+    // Fixed set of worker threads that run parallel loops. Workers sleep
+    // between jobs, so the pool is meant to live for the whole program.
+    class ThreadPool {
+    private:
+        // Fields other than next/done are guarded by mutex.
+        struct Job {
+            const std::function<void(int)> *task = nullptr;
+            int count = 0;
+            int helpers = 0;
+            int joined = 0;
+            std::atomic<int> next{0};
+            std::atomic<int> done{0};
+        };
+
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable finished;
+        std::mutex runMutex;
+        Job job;
+        unsigned long generation = 0;
+        int active = 0;
+        bool stopping = false;
+
+        void workerLoop();
+
+        void drain();
+
+    public:
+        explicit ThreadPool(int workers);
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        int workers() const {
+            return static_cast<int>(threads.size());
+        }
+
+        // Calls task(0) .. task(count - 1) on at most `threads` threads, the
+        // caller included, and returns once all of them have finished. Which
+        // thread runs which index is unspecified, so tasks must be independent
+        // and must not throw. If the pool is busy with another caller's loop
+        // the tasks run on the calling thread instead.
+        void parallelFor(int count, int threads, const std::function<void(int)> &task);
+    };
+} // Matrix
+
+#endif //THREADPOOL_H
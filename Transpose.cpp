@@ -0,0 +1,220 @@
+#include "Transpose.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+namespace Matrix {
+    namespace Transpose {
+        namespace {
+            // Blocks are split until both sides are at most Leaf elements: a
+            // 32 x 32 source and destination block together take 16 KiB.
+            constexpr int Leaf = 32;
+
+            // b[Tile x Tile] = transpose(a[Tile x Tile]).
+            using TileKernel = void (*)(const double *a, int lda, double *b, int ldb);
+
+            void tileScalar(const double *a, int lda, double *b, int ldb) {
+                for (int r = 0; r < Tile; ++r) {
+                    for (int c = 0; c < Tile; ++c) {
+                        b[static_cast<std::size_t>(c) * ldb + r] = a[static_cast<std::size_t>(r) * lda + c];
+                    }
+                }
+            }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+            // 2 x 2 register transposes over the 8 x 8 tile.
+            __attribute__((target("sse2")))
+            void tileSse2(const double *a, int lda, double *b, int ldb) {
+                for (int r = 0; r < Tile; r += 2) {
+                    const double *row0 = a + static_cast<std::size_t>(r) * lda;
+                    const double *row1 = row0 + lda;
+                    for (int c = 0; c < Tile; c += 2) {
+                        const __m128d x = _mm_loadu_pd(row0 + c);
+                        const __m128d y = _mm_loadu_pd(row1 + c);
+                        double *out = b + static_cast<std::size_t>(c) * ldb + r;
+                        _mm_storeu_pd(out, _mm_unpacklo_pd(x, y));
+                        _mm_storeu_pd(out + ldb, _mm_unpackhi_pd(x, y));
+                    }
+                }
+            }
+
+            // 4 x 4 register transposes over the 8 x 8 tile.
+            __attribute__((target("avx2")))
+            void tileAvx2(const double *a, int lda, double *b, int ldb) {
+                for (int r = 0; r < Tile; r += 4) {
+                    for (int c = 0; c < Tile; c += 4) {
+                        const double *in = a + static_cast<std::size_t>(r) * lda + c;
+                        const __m256d r0 = _mm256_loadu_pd(in);
+                        const __m256d r1 = _mm256_loadu_pd(in + lda);
+                        const __m256d r2 = _mm256_loadu_pd(in + 2 * static_cast<std::size_t>(lda));
+                        const __m256d r3 = _mm256_loadu_pd(in + 3 * static_cast<std::size_t>(lda));
+                        const __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+                        const __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+                        const __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+                        const __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+                        double *out = b + static_cast<std::size_t>(c) * ldb + r;
+                        _mm256_storeu_pd(out, _mm256_permute2f128_pd(t0, t2, 0x20));
+                        _mm256_storeu_pd(out + ldb, _mm256_permute2f128_pd(t1, t3, 0x20));
+                        _mm256_storeu_pd(out + 2 * static_cast<std::size_t>(ldb), _mm256_permute2f128_pd(t0, t2, 0x31));
+                        _mm256_storeu_pd(out + 3 * static_cast<std::size_t>(ldb), _mm256_permute2f128_pd(t1, t3, 0x31));
+                    }
+                }
+            }
+
+            // One 8 x 8 register transpose: pairs of rows are interleaved, then
+            // 128-bit lanes are gathered in two shuffle rounds.
+            __attribute__((target("avx512f")))
+            void tileAvx512(const double *a, int lda, double *b, int ldb) {
+                __m512d row[Tile];
+                for (int r = 0; r < Tile; ++r) {
+                    row[r] = _mm512_loadu_pd(a + static_cast<std::size_t>(r) * lda);
+                }
+                // The masked forms take an explicit pass-through operand; the
+                // plain ones trip GCC 12's -Wuninitialized in its own headers.
+                constexpr __mmask8 All = 0xFF;
+                __m512d t[Tile];
+                for (int r = 0; r < Tile; r += 2) {
+                    t[r] = _mm512_mask_unpacklo_pd(row[r], All, row[r], row[r + 1]);
+                    t[r + 1] = _mm512_mask_unpackhi_pd(row[r], All, row[r], row[r + 1]);
+                }
+                // t[0], t[2], t[4], t[6] hold the even columns, t[1], t[3], ... the odd.
+                for (int odd = 0; odd < 2; ++odd) {
+                    const __m512d s0 = _mm512_mask_shuffle_f64x2(t[odd], All, t[odd], t[odd + 2], 0x88);
+                    const __m512d s1 = _mm512_mask_shuffle_f64x2(t[odd + 4], All, t[odd + 4], t[odd + 6], 0x88);
+                    const __m512d s2 = _mm512_mask_shuffle_f64x2(t[odd], All, t[odd], t[odd + 2], 0xDD);
+                    const __m512d s3 = _mm512_mask_shuffle_f64x2(t[odd + 4], All, t[odd + 4], t[odd + 6], 0xDD);
+                    _mm512_storeu_pd(b + static_cast<std::size_t>(odd) * ldb, _mm512_mask_shuffle_f64x2(s0, All, s0, s1, 0x88));
+                    _mm512_storeu_pd(b + static_cast<std::size_t>(odd + 4) * ldb, _mm512_mask_shuffle_f64x2(s0, All, s0, s1, 0xDD));
+                    _mm512_storeu_pd(b + static_cast<std::size_t>(odd + 2) * ldb, _mm512_mask_shuffle_f64x2(s2, All, s2, s3, 0x88));
+                    _mm512_storeu_pd(b + static_cast<std::size_t>(odd + 6) * ldb, _mm512_mask_shuffle_f64x2(s2, All, s2, s3, 0xDD));
+                }
+            }
+#endif
+
+            TileKernel kernelFor(Simd::Isa isa) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+                switch (isa) {
+                    case Simd::Isa::AVX512: return tileAvx512;
+                    case Simd::Isa::AVX2: return tileAvx2;
+                    case Simd::Isa::SSE2: return tileSse2;
+                    default: break;
+                }
+#endif
+                return tileScalar;
+            }
+
+            // Half of `extent`, rounded to whole tiles so that only the last
+            // block along each side has a ragged edge.
+            int split(int extent) {
+                return std::max(Tile, extent / 2 / Tile * Tile);
+            }
+
+            // b[cols x rows] = transpose(a[rows x cols]).
+            void copyBlock(TileKernel tile, int rows, int cols, const double *a, int lda, double *b, int ldb) {
+                if (rows > Leaf || cols > Leaf) {
+                    if (rows >= cols) {
+                        const int h = split(rows);
+                        copyBlock(tile, h, cols, a, lda, b, ldb);
+                        copyBlock(tile, rows - h, cols, a + static_cast<std::size_t>(h) * lda, lda, b + h, ldb);
+                    } else {
+                        const int h = split(cols);
+                        copyBlock(tile, rows, h, a, lda, b, ldb);
+                        copyBlock(tile, rows, cols - h, a + h, lda, b + static_cast<std::size_t>(h) * ldb, ldb);
+                    }
+                    return;
+                }
+                const int fullRows = rows / Tile * Tile;
+                const int fullCols = cols / Tile * Tile;
+                for (int r = 0; r < fullRows; r += Tile) {
+                    for (int c = 0; c < fullCols; c += Tile) {
+                        tile(a + static_cast<std::size_t>(r) * lda + c, lda, b + static_cast<std::size_t>(c) * ldb + r, ldb);
+                    }
+                }
+                for (int r = 0; r < rows; ++r) {
+                    for (int c = r < fullRows ? fullCols : 0; c < cols; ++c) {
+                        b[static_cast<std::size_t>(c) * ldb + r] = a[static_cast<std::size_t>(r) * lda + c];
+                    }
+                }
+            }
+
+            // Exchanges p[rows x cols] with transpose(q[cols x rows]); both live
+            // in the same matrix, on opposite sides of the diagonal.
+            void swapBlock(TileKernel tile, int rows, int cols, double *p, double *q, int ld) {
+                if (rows > Leaf || cols > Leaf) {
+                    if (rows >= cols) {
+                        const int h = split(rows);
+                        swapBlock(tile, h, cols, p, q, ld);
+                        swapBlock(tile, rows - h, cols, p + static_cast<std::size_t>(h) * ld, q + h, ld);
+                    } else {
+                        const int h = split(cols);
+                        swapBlock(tile, rows, h, p, q, ld);
+                        swapBlock(tile, rows, cols - h, p + h, q + static_cast<std::size_t>(h) * ld, ld);
+                    }
+                    return;
+                }
+                const int fullRows = rows / Tile * Tile;
+                const int fullCols = cols / Tile * Tile;
+                alignas(64) double buffer[Tile * Tile];
+                for (int r = 0; r < fullRows; r += Tile) {
+                    for (int c = 0; c < fullCols; c += Tile) {
+                        double *x = p + static_cast<std::size_t>(r) * ld + c;
+                        double *y = q + static_cast<std::size_t>(c) * ld + r;
+                        tile(x, ld, buffer, Tile);
+                        tile(y, ld, x, ld);
+                        for (int i = 0; i < Tile; ++i) {
+                            std::copy(buffer + i * Tile, buffer + (i + 1) * Tile, y + static_cast<std::size_t>(i) * ld);
+                        }
+                    }
+                }
+                for (int r = 0; r < rows; ++r) {
+                    for (int c = r < fullRows ? fullCols : 0; c < cols; ++c) {
+                        std::swap(p[static_cast<std::size_t>(r) * ld + c], q[static_cast<std::size_t>(c) * ld + r]);
+                    }
+                }
+            }
+
+            // Transposes the n x n block on the diagonal starting at a.
+            void diagonalBlock(TileKernel tile, int n, double *a, int ld) {
+                if (n > Leaf) {
+                    const int h = split(n);
+                    double *lower = a + static_cast<std::size_t>(h) * ld;
+                    diagonalBlock(tile, h, a, ld);
+                    diagonalBlock(tile, n - h, lower + h, ld);
+                    swapBlock(tile, h, n - h, a + h, lower, ld);
+                    return;
+                }
+                const int full = n / Tile * Tile;
+                alignas(64) double buffer[Tile * Tile];
+                for (int r = 0; r < full; r += Tile) {
+                    double *x = a + static_cast<std::size_t>(r) * ld + r;
+                    tile(x, ld, buffer, Tile);
+                    for (int i = 0; i < Tile; ++i) {
+                        std::copy(buffer + i * Tile, buffer + (i + 1) * Tile, x + static_cast<std::size_t>(i) * ld);
+                    }
+                    for (int c = r + Tile; c < full; c += Tile) {
+                        swapBlock(tile, Tile, Tile, a + static_cast<std::size_t>(r) * ld + c,
+                                  a + static_cast<std::size_t>(c) * ld + r, ld);
+                    }
+                }
+                for (int r = 0; r < n; ++r) {
+                    for (int c = std::max(r + 1, full); c < n; ++c) {
+                        std::swap(a[static_cast<std::size_t>(r) * ld + c], a[static_cast<std::size_t>(c) * ld + r]);
+                    }
+                }
+            }
+        }
+
+        void copy(int n, const double *a, int lda, double *b, int ldb) {
+            copyBlock(kernelFor(Simd::active()), n, n, a, lda, b, ldb);
+        }
+
+        void inPlace(int n, double *a, int lda) {
+            diagonalBlock(kernelFor(Simd::active()), n, a, lda);
+        }
+    } // Transpose
+} // Matrix
@@ -0,0 +1,21 @@
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+namespace Matrix {
+    namespace Transpose {
+        // Operands are n x n row-major with rows lda / ldb elements apart. Both
+        // routines split the matrix recursively until a block pair fits in L1,
+        // then move Tile x Tile blocks through registers with the kernel that
+        // matches Simd::active().
+        constexpr int Tile = 8;
+
+        // b = transpose(a); b must not alias a.
+        void copy(int n, const double *a, int lda, double *b, int ldb);
+
+        // a = transpose(a), swapping blocks across the diagonal without a
+        // second matrix.
+        void inPlace(int n, double *a, int lda);
+    } // Transpose
+} // Matrix
+
+#endif //TRANSPOSE_H
@@ -1,15 +1,16 @@
 #include <iostream>
+#include <memory>
 #include "SquareMat.h"  // Your header file
 using namespace Matrix;
 
-double** create_array(int n, std::initializer_list<std::initializer_list<double>> init) {
-    double** arr = new double*[n];
+// Row-major buffer for an n x n matrix; SquareMat adopts it without copying.
+std::unique_ptr<double[]> create_array(int n, std::initializer_list<std::initializer_list<double>> init) {
+    std::unique_ptr<double[]> arr(new double[n * n]);
     int i = 0;
     for (auto& row : init) {
-        arr[i] = new double[n];
         int j = 0;
         for (auto& val : row) {
-            arr[i][j++] = val;
+            arr[i * n + j++] = val;
         }
         ++i;
     }